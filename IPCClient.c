@@ -22,6 +22,8 @@ ipc_client_new(int fd)
   c->next = NULL;
   c->prev = NULL;
   c->subscriptions = 0;
+  for (int i = 0; i < IPC_EVENT_COUNT; i++)
+    c->filters[i] = (IPCEventFilter){.monitor = -1};
 
   return c;
 }
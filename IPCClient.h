@@ -5,6 +5,22 @@
 #include <stdlib.h>
 #include <sys/epoll.h>
 
+// Number of IPCEvent types, keep in sync with the IPCEvent enum in ipc.h
+#define IPC_EVENT_COUNT 6
+
+/**
+ * Filter attached to an event subscription. Each member narrows down which
+ * events are delivered to the subscriber. A member only applies to events that
+ * carry the matching property; -1 for monitor and 0 for the rest match
+ * anything.
+ */
+typedef struct IPCEventFilter {
+  int monitor;
+  unsigned int tags;
+  unsigned long window;
+  unsigned int fields;
+} IPCEventFilter;
+
 typedef struct IPCClient IPCClient;
 /**
  * This structure contains the details of an IPC Client and pointers for a
@@ -13,6 +29,7 @@ typedef struct IPCClient IPCClient;
 struct IPCClient {
   int fd;
   int subscriptions;
+  IPCEventFilter filters[IPC_EVENT_COUNT];
 
   char *buffer;
   uint32_t buffer_size;
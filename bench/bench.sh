@@ -0,0 +1,147 @@
+#!/usr/bin/env sh
+
+# End to end benchmark of dwm on a headless Xvfb server. First runs the
+# bench/drwbench rendering microbenchmarks. Then for each client count dwm is
+# started fresh, bench/xclients maps the clients and reports map-to-tiled
+# latency, then tag switches, layout cycles and focus storms are driven over
+# IPC. Reports latencies and the CPU time dwm used per run.
+#
+# Usage: bench/bench.sh [counts...]   (default: 10 100 500)
+#
+# If SESSION names a session log recorded with dwm -r, it is also played back
+# as fast as possible with bench/replay and the handler statistics of dwm are
+# printed afterwards.
+#
+# dwm binds the IPC socket at the path in config.h, so do not run this while
+# another dwm instance is using it.
+
+DISPLAYNUM=${DISPLAYNUM:-:99}
+ROUNDS=${ROUNDS:-200}
+DIR=$(cd "$(dirname "$0")/.." && pwd)
+DWM="$DIR/dwm"
+MSG="$DIR/dwm-msg"
+XCLIENTS="$DIR/bench/xclients"
+DRWBENCH="$DIR/bench/drwbench"
+REPLAY="$DIR/bench/replay"
+TMP=$(mktemp -d)
+HZ=$(getconf CLK_TCK)
+# dwm runs autostart scripts from the home directory, keep those of the user
+# out of the measurements
+mkdir -p "$TMP/home/.local/share"
+
+[ $# -gt 0 ] && COUNTS="$*" || COUNTS="10 100 500"
+
+for bin in Xvfb "$DWM" "$MSG" "$XCLIENTS" "$DRWBENCH" "$REPLAY"; do
+	command -v "$bin" >/dev/null || { echo "bench: $bin not found" >&2; exit 1; }
+done
+
+cleanup() {
+	[ -n "$clients" ] && kill "$clients" 2>/dev/null
+	[ -n "$dwm" ] && kill "$dwm" 2>/dev/null
+	[ -n "$xvfb" ] && kill "$xvfb" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$TMP"
+}
+trap cleanup EXIT INT TERM
+
+# Prints user + system CPU time of a process in clock ticks.
+cputicks() {
+	awk '{ print $14 + $15 }' "/proc/$1/stat"
+}
+
+# Waits up to 10 s for a command to succeed.
+waitfor() {
+	i=0
+	until "$@" >/dev/null 2>&1; do
+		i=$((i + 1))
+		[ $i -gt 100 ] && { echo "bench: timed out waiting for $*" >&2; exit 1; }
+		sleep 0.1
+	done
+}
+
+nsnow() {
+	date +%s%N
+}
+
+# Runs the same IPC command ROUNDS times over one connection, each after the
+# reply to the previous one, and prints the mean time per command. A batch
+# would be applied with a single arrange, so stream mode is used instead.
+storm() {
+	name=$1
+	shift
+	i=0
+	while [ $i -lt "$ROUNDS" ]; do
+		echo "run_command $*"
+		i=$((i + 1))
+	done > "$TMP/storm"
+	start=$(nsnow)
+	"$MSG" stream < "$TMP/storm" >/dev/null
+	end=$(nsnow)
+	echo "$name: $ROUNDS in $(( (end - start) / 1000 )) us, $(( (end - start) / ROUNDS / 1000 )) us each"
+}
+
+Xvfb "$DISPLAYNUM" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+export DISPLAY="$DISPLAYNUM"
+waitfor xdpyinfo
+
+echo "== drw"
+"$DRWBENCH"
+
+if [ -n "$SESSION" ]; then
+	echo "== replay $SESSION"
+	HOME="$TMP/home" XDG_DATA_HOME="$TMP/home/.local/share" "$DWM" >"$TMP/dwm.log" 2>&1 &
+	dwm=$!
+	waitfor "$MSG" get_tags
+	before=$(cputicks "$dwm")
+	"$REPLAY" -f "$SESSION"
+	after=$(cputicks "$dwm")
+	echo "dwm cpu time: $(( (after - before) * 1000 / HZ )) ms"
+	"$MSG" get_stats
+	"$MSG" --ignore-reply run_command quit
+	wait "$dwm" 2>/dev/null
+	dwm=
+fi
+
+for n in $COUNTS; do
+	echo "== $n clients"
+
+	HOME="$TMP/home" XDG_DATA_HOME="$TMP/home/.local/share" "$DWM" >"$TMP/dwm.log" 2>&1 &
+	dwm=$!
+	waitfor "$MSG" get_tags
+	before=$(cputicks "$dwm")
+
+	"$XCLIENTS" -n "$n" >"$TMP/clients.log" &
+	clients=$!
+	waitfor grep -q ready "$TMP/clients.log"
+	grep -v ready "$TMP/clients.log"
+
+	# make sure "view 0" toggles between two tagsets
+	"$MSG" --ignore-reply run_command view 2
+	"$MSG" --ignore-reply run_command view 1
+	"$MSG" benchmark --requests "$ROUNDS" --events "$ROUNDS" get_monitors
+
+	for addr in $("$MSG" get_layouts | grep -o '"address": *[0-9]*' | grep -o '[0-9]*$'); do
+		echo "run_command setlayoutsafe $addr"
+	done > "$TMP/layouts"
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		cat "$TMP/layouts"
+	done > "$TMP/storm"
+	start=$(nsnow)
+	"$MSG" stream < "$TMP/storm" >/dev/null
+	end=$(nsnow)
+	echo "layout cycle: $(wc -l < "$TMP/storm") layouts in $(( (end - start) / 1000 )) us"
+
+	storm "focus storm" focusstackvis 1
+	storm "zoom storm" zoom
+
+	kill "$clients"
+	wait "$clients" 2>/dev/null
+	clients=
+	after=$(cputicks "$dwm")
+	echo "dwm cpu time: $(( (after - before) * 1000 / HZ )) ms"
+
+	"$MSG" --ignore-reply run_command quit
+	wait "$dwm" 2>/dev/null
+	dwm=
+done
@@ -0,0 +1,129 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Microbenchmarks for the rendering layer: drw_text with and without font
+ * fallback, drw_fontset_getwidth, the status text parser in drawstatusbar()
+ * and both scaling paths of drw_picture_create_resized(). dwm.c is included
+ * (with its main renamed) so the status parser is measured as it is built,
+ * together with the fonts and colors of config.h. Needs an X display, e.g.
+ * Xvfb. Results are in ns per operation, including the time the X server
+ * takes to process the requests.
+ */
+#define main dwmmain
+#include "../dwm.c"
+#undef main
+
+static const char latin[] = "The quick brown fox jumps over the lazy dog 0123456789";
+static const char cjk[] = "\xe6\xbc\xa2\xe5\xad\x97\xe3\x81\xb2\xe3\x82\x89\xe3\x81\x8c\xe3\x81\xaa"
+	"\xe3\x82\xab\xe3\x82\xbf\xe3\x82\xab\xe3\x83\x8a\xed\x95\x9c\xea\xb5\xad\xec\x96\xb4";
+static const char emoji[] = "\xf0\x9f\x98\x80 \xf0\x9f\x9a\x80 \xf0\x9f\x8e\x89 \xf0\x9f\x94\xa5 "
+	"\xf0\x9f\x91\x8d \xf0\x9f\x8c\x88 \xf0\x9f\x8d\x95 \xf0\x9f\x90\xa7";
+static char longtitle[512];
+static char status[1024];
+static char *icon;
+static Monitor *benchmon;
+
+static uint64_t
+benchnow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+bench(const char *name, long iters, void (*fn)(void))
+{
+	uint64_t start;
+	long i;
+
+	fn(); /* warm up font and glyph caches */
+	XSync(dpy, False);
+	start = benchnow();
+	for (i = 0; i < iters; i++)
+		fn();
+	XSync(dpy, False);
+	printf("%-24s %10ld ops %12.0f ns/op\n", name, iters,
+		(double)(benchnow() - start) / iters);
+}
+
+static void textlatin(void) { drw_text(drw, 0, 0, sw, bh, lrpad / 2, latin, 0); }
+static void textcjk(void) { drw_text(drw, 0, 0, sw, bh, lrpad / 2, cjk, 0); }
+static void textemoji(void) { drw_text(drw, 0, 0, sw, bh, lrpad / 2, emoji, 0); }
+static void getwidth(void) { drw_fontset_getwidth(drw, longtitle); }
+static void statusparse(void) { drawstatusbar(benchmon, bh, status, 0); }
+
+/* Source at most twice the target size, scaled by XRender */
+static void
+picxrender(void)
+{
+	XRenderFreePicture(dpy, drw_picture_create_resized(drw, icon, 48, 48, 32, 32));
+}
+
+/* Larger sources are scaled down with imlib first */
+static void
+picimlib(void)
+{
+	XRenderFreePicture(dpy, drw_picture_create_resized(drw, icon, 256, 256, 32, 32));
+}
+
+int
+main(int argc, char *argv[])
+{
+	long iters = argc > 1 ? atol(argv[1]) : 10000;
+	size_t i;
+	int n;
+
+	if (iters < 1)
+		die("usage: drwbench [iterations]");
+	if (!setlocale(LC_CTYPE, "") || !XSupportsLocale())
+		fputs("warning: no locale support\n", stderr);
+	if (!(dpy = XOpenDisplay(NULL)))
+		die("drwbench: cannot open display");
+	screen = DefaultScreen(dpy);
+	sw = DisplayWidth(dpy, screen);
+	sh = DisplayHeight(dpy, screen);
+	root = RootWindow(dpy, screen);
+	xinitvisual();
+	drw = drw_create(dpy, screen, root, sw, sh, visual, depth, cmap);
+	if (!drw_fontset_create(drw, fonts, LENGTH(fonts)))
+		die("no fonts could be loaded.");
+	lrpad = drw->fonts->h + horizpadbar;
+	bh = user_bh ? user_bh : drw->fonts->h + horizpadbar;
+	scheme = ecalloc(LENGTH(colors) + 1, sizeof(Clr *));
+	scheme[LENGTH(colors)] = drw_scm_create(drw, colors[0], alphas[0], 4);
+	for (i = 0; i < LENGTH(colors); i++)
+		scheme[i] = drw_scm_create(drw, colors[i], alphas[i], 4);
+	drw_setscheme(drw, scheme[SchemeNorm]);
+	systray = ecalloc(1, sizeof(Systray));
+	benchmon = ecalloc(1, sizeof(Monitor));
+	benchmon->ww = sw;
+
+	for (i = 0; i + sizeof latin < sizeof longtitle; i += sizeof latin - 1)
+		memcpy(longtitle + i, latin, sizeof latin);
+	for (i = 0, n = 0; n < 16; n++)
+		i += snprintf(status + i, sizeof status - i,
+			"^c#%06x^cpu %d%% ^r0,4,%d,8^^f10^^b#222222^^d^| ",
+			n * 0x0f0f0f & 0xffffff, n, n + 2);
+	icon = ecalloc(256 * 256, 4);
+	for (i = 0; i < 256 * 256; i++)
+		((uint32_t *)icon)[i] = 0xff000000 | (i * 2654435761u & 0xffffff);
+
+	bench("drw_text latin", iters, textlatin);
+	bench("drw_text cjk", iters, textcjk);
+	bench("drw_text emoji", iters, textemoji);
+	bench("drw_fontset_getwidth", iters, getwidth);
+	bench("drawstatusbar", iters / 10 + 1, statusparse);
+	bench("picture xrender", iters / 10 + 1, picxrender);
+	bench("picture imlib", iters / 10 + 1, picimlib);
+
+	free(icon);
+	free(benchmon);
+	free(systray);
+	for (i = 0; i < LENGTH(colors) + 1; i++)
+		drw_scm_free(drw, scheme[i], 4);
+	free(scheme);
+	drw_free(drw);
+	XCloseDisplay(dpy);
+	return 0;
+}
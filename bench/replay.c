@@ -0,0 +1,376 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Plays back a session log recorded with dwm -r against a dwm running on
+ * another X server, usually Xvfb. The replay acts as all the recorded
+ * clients: it creates a window with the recorded class, instance and title
+ * for every MapRequest, and reproduces what the clients did to them
+ * (configure requests, title changes, client messages, unmapping and
+ * destroying). Key and button presses and pointer motion are injected with
+ * XTest, and IPC messages are sent to the dwm socket. Events dwm derives from
+ * others, such as EnterNotify, FocusIn and Expose, are not injected as they
+ * are generated again by the replay.
+ *
+ * Properties other than the title are not recorded with their values, and
+ * UnmapNotify events caused by dwm itself are replayed as client unmaps,
+ * which is harmless as the window is unmapped already at that point.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XTest.h>
+
+#include "../record.h"
+#include "../util.h"
+
+#define IPCSOCKET    "/tmp/dwm.sock" /* ipcsockpath in config.h */
+#define IPCSUBSCRIBE 5               /* IPC_TYPE_SUBSCRIBE in ipc.h */
+
+typedef struct {
+	uint32_t recorded;
+	Window win;
+} WinMap;
+
+typedef struct {
+	uint32_t recorded;
+	Atom atom;
+} AtomMap;
+
+static Display *dpy;
+static Window root;
+static Atom netwmname, netwmstate, utf8string;
+static WinMap *wins;
+static size_t nwins;
+static AtomMap *atoms;
+static size_t natoms;
+static int ipcfd = -1;
+static unsigned long titlerev;
+
+static double
+nowus(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static Window
+getwin(uint32_t recorded)
+{
+	size_t i;
+
+	for (i = 0; i < nwins; i++)
+		if (wins[i].recorded == recorded)
+			return wins[i].win;
+	return None;
+}
+
+/* Maps a recorded atom to the atom of the same name on this server. Atoms
+ * predefined by the protocol are the same everywhere. */
+static Atom
+getatom(uint32_t recorded)
+{
+	size_t i;
+
+	if (recorded <= XA_LAST_PREDEFINED)
+		return recorded;
+	for (i = 0; i < natoms; i++)
+		if (atoms[i].recorded == recorded)
+			return atoms[i].atom;
+	return None;
+}
+
+static void
+addatom(const char *p, uint32_t len)
+{
+	uint32_t id;
+
+	if (len <= sizeof id)
+		return;
+	memcpy(&id, p, sizeof id);
+	atoms = realloc(atoms, (natoms + 1) * sizeof(AtomMap));
+	if (!atoms)
+		die("replay: realloc:");
+	atoms[natoms].recorded = id;
+	atoms[natoms++].atom = XInternAtom(dpy, p + sizeof id, False);
+}
+
+static void
+settitle(Window w, const char *title)
+{
+	XStoreName(dpy, w, title);
+	XChangeProperty(dpy, w, netwmname, utf8string, 8, PropModeReplace,
+		(unsigned char *)title, strlen(title));
+}
+
+/* Creates the stand-in for a client window, to be mapped by its MapRequest */
+static void
+addwindow(const char *p, uint32_t len)
+{
+	XClassHint ch;
+	uint32_t id;
+	Window w;
+
+	if (len <= sizeof id || p[len - 1] != '\0')
+		return;
+	memcpy(&id, p, sizeof id);
+	if (getwin(id))
+		return;
+	ch.res_name = (char *)p + sizeof id;
+	ch.res_class = ch.res_name + strlen(ch.res_name) + 1;
+	if (ch.res_class >= p + len)
+		return;
+	w = XCreateSimpleWindow(dpy, root, 0, 0, 200, 100, 0, 0, 0);
+	XSetClassHint(dpy, w, &ch);
+	if (ch.res_class + strlen(ch.res_class) + 1 < p + len)
+		settitle(w, ch.res_class + strlen(ch.res_class) + 1);
+	wins = realloc(wins, (nwins + 1) * sizeof(WinMap));
+	if (!wins)
+		die("replay: realloc:");
+	wins[nwins].recorded = id;
+	wins[nwins++].win = w;
+}
+
+/* Presses or releases the modifier keys in state */
+static void
+fakemods(unsigned int state, Bool press)
+{
+	XModifierKeymap *mm = XGetModifierMapping(dpy);
+	int i;
+
+	for (i = 0; i < 8; i++)
+		if (state & (1 << i) && mm->modifiermap[i * mm->max_keypermod])
+			XTestFakeKeyEvent(dpy, mm->modifiermap[i * mm->max_keypermod], press, CurrentTime);
+	XFreeModifiermap(mm);
+}
+
+static void
+replayxevent(int type, RecXPayload *p, uint32_t len)
+{
+	Window w = p->window ? getwin(p->window) : root;
+	int32_t *a = p->args;
+	int n = (len - (sizeof *p - sizeof p->args)) / sizeof p->args[0];
+	XWindowChanges wc;
+	XEvent ev;
+	char buf[64];
+	int i;
+
+	switch (type) {
+	case KeyPress:
+		if (n < 2)
+			break;
+		fakemods(a[1], True);
+		XTestFakeKeyEvent(dpy, a[0], True, CurrentTime);
+		XTestFakeKeyEvent(dpy, a[0], False, CurrentTime);
+		fakemods(a[1], False);
+		break;
+	case ButtonPress:
+	case ButtonRelease:
+		if (n < 4)
+			break;
+		XTestFakeMotionEvent(dpy, -1, a[2], a[3], CurrentTime);
+		if (type == ButtonPress)
+			fakemods(a[1], True);
+		XTestFakeButtonEvent(dpy, a[0], type == ButtonPress, CurrentTime);
+		if (type == ButtonRelease)
+			fakemods(a[1], False);
+		break;
+	case MotionNotify:
+		if (n >= 2)
+			XTestFakeMotionEvent(dpy, -1, a[0], a[1], CurrentTime);
+		break;
+	case PropertyNotify:
+		if (!w || n < 2 || a[1] != PropertyNewValue)
+			break;
+		if (getatom(a[0]) == XA_WM_NAME || getatom(a[0]) == netwmname) {
+			snprintf(buf, sizeof buf, "replay %lu", ++titlerev);
+			settitle(w, buf);
+		}
+		break;
+	case ClientMessage:
+		if (!w || n < 6)
+			break;
+		memset(&ev, 0, sizeof ev);
+		ev.xclient.type = ClientMessage;
+		ev.xclient.window = w;
+		ev.xclient.message_type = getatom(a[0]);
+		ev.xclient.format = 32;
+		for (i = 0; i < 5; i++)
+			ev.xclient.data.l[i] = a[i + 1];
+		if (ev.xclient.message_type == netwmstate) {
+			ev.xclient.data.l[1] = a[2] ? getatom(a[2]) : None;
+			ev.xclient.data.l[2] = a[3] ? getatom(a[3]) : None;
+		}
+		XSendEvent(dpy, root, False, SubstructureNotifyMask | SubstructureRedirectMask, &ev);
+		break;
+	case ConfigureRequest:
+		if (!w || n < 6)
+			break;
+		wc.x = a[0];
+		wc.y = a[1];
+		wc.width = a[2];
+		wc.height = a[3];
+		wc.border_width = a[4];
+		XConfigureWindow(dpy, w, a[5] & (CWX | CWY | CWWidth | CWHeight | CWBorderWidth), &wc);
+		break;
+	case MapRequest:
+		if (w)
+			XMapWindow(dpy, w);
+		break;
+	case UnmapNotify:
+		if (w && w != root)
+			XUnmapWindow(dpy, w);
+		break;
+	case DestroyNotify:
+		if (w && w != root) {
+			XDestroyWindow(dpy, w);
+			for (i = 0; i < (int)nwins; i++)
+				if (wins[i].win == w)
+					wins[i] = wins[--nwins];
+		}
+		break;
+	}
+}
+
+static int
+readall(int fd, char *buf, size_t len)
+{
+	ssize_t n;
+
+	for (; len; buf += n, len -= n)
+		if ((n = read(fd, buf, len)) <= 0)
+			return -1;
+	return 0;
+}
+
+static void
+replayipc(int type, const char *msg, uint32_t len)
+{
+	char hdr[12], *reply;
+	uint32_t size;
+
+	if (ipcfd < 0 || type == IPCSUBSCRIBE)
+		return;
+	memcpy(hdr, "DWM-IPC", 7);
+	memcpy(hdr + 7, &len, 4);
+	hdr[11] = type;
+	if (write(ipcfd, hdr, sizeof hdr) != sizeof hdr
+	|| (len && write(ipcfd, msg, len) != (ssize_t)len))
+		die("replay: write:");
+	/* wait for the reply, so messages are not handled out of order with
+	 * the X events that follow */
+	if (readall(ipcfd, hdr, sizeof hdr) < 0)
+		die("replay: read:");
+	memcpy(&size, hdr + 7, 4);
+	reply = ecalloc(1, size + 1);
+	if (readall(ipcfd, reply, size) < 0)
+		die("replay: read:");
+	free(reply);
+}
+
+static void
+ipcconnect(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	strncpy(addr.sun_path, IPCSOCKET, sizeof addr.sun_path - 1);
+	if ((ipcfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+	|| connect(ipcfd, (struct sockaddr *)&addr, sizeof addr) < 0) {
+		fprintf(stderr, "replay: cannot connect to %s, IPC messages are skipped\n", IPCSOCKET);
+		if (ipcfd >= 0)
+			close(ipcfd);
+		ipcfd = -1;
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	FILE *f;
+	RecHeader h;
+	char magic[sizeof RECMAGIC], *buf = NULL;
+	unsigned long xevents = 0, ipcmsgs = 0;
+	double speed = 1, start, due;
+	int i, fast = 0;
+
+	for (i = 1; i < argc - 1; i++) {
+		if (!strcmp(argv[i], "-f"))
+			fast = 1;
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc - 1)
+			speed = atof(argv[++i]);
+		else
+			break;
+	}
+	if (i != argc - 1 || speed <= 0)
+		die("usage: replay [-f] [-s speed] sessionlog");
+	if (!(f = fopen(argv[i], "r")))
+		die("replay: cannot open %s:", argv[i]);
+	if (fread(magic, sizeof magic, 1, f) != 1 || memcmp(magic, RECMAGIC, sizeof magic))
+		die("replay: %s is not a session log", argv[i]);
+	if (!(dpy = XOpenDisplay(NULL)))
+		die("replay: cannot open display");
+	if (!XTestQueryExtension(dpy, &i, &i, &i, &i))
+		die("replay: XTest extension missing");
+	root = DefaultRootWindow(dpy);
+	netwmname = XInternAtom(dpy, "_NET_WM_NAME", False);
+	netwmstate = XInternAtom(dpy, "_NET_WM_STATE", False);
+	utf8string = XInternAtom(dpy, "UTF8_STRING", False);
+	ipcconnect();
+
+	start = due = nowus();
+	while (fread(&h, sizeof h, 1, f) == 1) {
+		if (!(buf = realloc(buf, h.len + 1)))
+			die("replay: realloc:");
+		if (h.len && fread(buf, h.len, 1, f) != 1)
+			die("replay: truncated record");
+		buf[h.len] = '\0';
+		if (!fast) {
+			due += h.dt / speed;
+			XFlush(dpy);
+			if (due > nowus())
+				usleep(due - nowus());
+		}
+		switch (h.kind) {
+		case RecAtom:
+			addatom(buf, h.len);
+			break;
+		case RecWindow:
+			addwindow(buf, h.len);
+			break;
+		case RecXEvent:
+			if (h.len >= sizeof(RecXPayload) - sizeof(((RecXPayload *)0)->args)) {
+				RecXPayload p = { 0 };
+
+				memcpy(&p, buf, MIN(h.len, sizeof p));
+				replayxevent(h.type, &p, MIN(h.len, sizeof p));
+				xevents++;
+			}
+			break;
+		case RecIPC:
+			XSync(dpy, False);
+			replayipc(h.type, buf, h.len);
+			ipcmsgs++;
+			break;
+		}
+	}
+	XSync(dpy, False);
+	printf("replayed %lu X events and %lu IPC messages in %.3f s\n",
+		xevents, ipcmsgs, (nowus() - start) / 1e6);
+
+	free(buf);
+	free(wins);
+	free(atoms);
+	fclose(f);
+	if (ipcfd >= 0)
+		close(ipcfd);
+	XCloseDisplay(dpy);
+	return 0;
+}
@@ -0,0 +1,172 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Synthetic X clients for bench.sh. Opens n windows one after another, each
+ * with a title and an icon, and measures how long dwm takes from the map
+ * request until the window is mapped, which dwm only does after it has been
+ * managed and arranged. Afterwards titles are rewritten to stress
+ * propertynotify, timed only until the X server has taken them, and windows
+ * are unmapped and mapped again to stress manage/unmanage. Prints "ready"
+ * once done and keeps the windows open until terminated.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "../util.h"
+
+#define ICONSIZE 32
+
+static Display *dpy;
+static Window root;
+static Atom netwmname, netwmicon, utf8string;
+
+static double
+nowus(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int
+cmpdouble(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void
+report(const char *name, double *lat, int n)
+{
+	if (!n) {
+		printf("%s: no samples\n", name);
+		return;
+	}
+	qsort(lat, n, sizeof(double), cmpdouble);
+	printf("%s: %d samples, p50 %.1f us, p99 %.1f us, max %.1f us\n", name, n,
+		lat[(n - 1) * 50 / 100], lat[(n - 1) * 99 / 100], lat[n - 1]);
+}
+
+static void
+settitle(Window w, int i, int rev)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof buf, "dwmbench client %d rev %d", i, rev);
+	XStoreName(dpy, w, buf);
+	XChangeProperty(dpy, w, netwmname, utf8string, 8, PropModeReplace,
+		(unsigned char *)buf, strlen(buf));
+}
+
+static void
+seticon(Window w, int i)
+{
+	static long icon[2 + ICONSIZE * ICONSIZE];
+	int p;
+
+	icon[0] = icon[1] = ICONSIZE;
+	for (p = 0; p < ICONSIZE * ICONSIZE; p++)
+		icon[2 + p] = 0xff000000 | ((i * 2654435761u + p) & 0xffffff);
+	XChangeProperty(dpy, w, netwmicon, XA_CARDINAL, 32, PropModeReplace,
+		(unsigned char *)icon, 2 + ICONSIZE * ICONSIZE);
+}
+
+/* Maps w and waits for its MapNotify, discarding everything else. */
+static double
+mapwait(Window w)
+{
+	XEvent ev;
+	double start = nowus();
+
+	XMapWindow(dpy, w);
+	do
+		XNextEvent(dpy, &ev);
+	while (ev.type != MapNotify || ev.xmap.window != w);
+	return nowus() - start;
+}
+
+static void
+unmapwait(Window w)
+{
+	XEvent ev;
+
+	XUnmapWindow(dpy, w);
+	do
+		XNextEvent(dpy, &ev);
+	while (ev.type != UnmapNotify || ev.xunmap.window != w);
+}
+
+static void
+usage(void)
+{
+	die("usage: xclients [-n clients] [-u title updates] [-c map cycles]");
+}
+
+int
+main(int argc, char *argv[])
+{
+	XClassHint ch = { "dwmbench", "dwmbench" };
+	Window *wins;
+	double *lat, start;
+	int i, j, n = 10, updates = 100, cycles = 1;
+
+	for (i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "-n"))
+			n = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-u"))
+			updates = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-c"))
+			cycles = atoi(argv[i + 1]);
+		else
+			usage();
+	}
+	if (i != argc || n < 1)
+		usage();
+
+	if (!(dpy = XOpenDisplay(NULL)))
+		die("xclients: cannot open display");
+	root = DefaultRootWindow(dpy);
+	netwmname = XInternAtom(dpy, "_NET_WM_NAME", False);
+	netwmicon = XInternAtom(dpy, "_NET_WM_ICON", False);
+	utf8string = XInternAtom(dpy, "UTF8_STRING", False);
+
+	wins = ecalloc(n, sizeof(Window));
+	lat = ecalloc(n * MAX(cycles, 1), sizeof(double));
+
+	for (i = 0; i < n; i++) {
+		wins[i] = XCreateSimpleWindow(dpy, root, 0, 0, 200, 100, 0, 0, 0);
+		XSelectInput(dpy, wins[i], StructureNotifyMask);
+		XSetClassHint(dpy, wins[i], &ch);
+		settitle(wins[i], i, 0);
+		seticon(wins[i], i);
+		lat[i] = mapwait(wins[i]);
+	}
+	report("map-to-tiled", lat, n);
+
+	start = nowus();
+	for (j = 1; j <= updates; j++)
+		for (i = 0; i < n; i++)
+			settitle(wins[i], i, j);
+	XSync(dpy, False);
+	printf("title updates (client side): %d in %.3f s\n", updates * n, (nowus() - start) / 1e6);
+
+	for (j = 0; j < cycles; j++)
+		for (i = 0; i < n; i++) {
+			unmapwait(wins[i]);
+			lat[j * n + i] = mapwait(wins[i]);
+		}
+	report("unmap/map cycle", lat, n * cycles);
+
+	puts("ready");
+	fflush(stdout);
+
+	for (;;)
+		pause();
+}
@@ -25,6 +25,8 @@ static int showbar            = 1;        /* 0 means no bar */
 
 static int topbar             = 1;        /* 0 means bottom bar */
 
+static const unsigned int redrawinterval = 0; /* us between bar and tab redraws, 0 means one frame of the display */
+
 static const char slopspawnstyle[]  = "-t 0 -c 0.92,0.85,0.69,0.3 -o"; /* do NOT define -f (format) here */
 static const char slopresizestyle[] = "-t 0 -c 0.92,0.85,0.69,0.3"; /* do NOT define -f (format) here */
 static const int riodraw_borders    = 0;        /* 0 or 1, indicates whether the area drawn using slop includes the window borders */
@@ -273,7 +275,8 @@ static const char *scratchpadcmd[] = {"s", "st", "-t", "scratchpad", NULL};
 
 
 /*
- * Xresources preferences to load at startup
+ * Xresources preferences to load at startup and on xrdb (SIGUSR2 or the
+ * xrdb IPC command)
  */
 ResourcePref resources[] = {
 		{ "font1",               	STRING,  &font1 },
@@ -522,6 +525,8 @@ static Signal signals[] = {
 };
 
 static const char *ipcsockpath = "/tmp/dwm.sock";
+static const char *tracefile = "/tmp/dwm-trace.json"; /* written on SIGUSR1 or dumptrace, needs TRACE in config.mk */
+static const unsigned int roundtripbudget = 4; /* debug builds warn about event handlers making more X round trips, 0 disables */
 static IPCCommand ipccommands[] = {
   IPCCOMMAND(  view,                1,      {ARG_TYPE_UINT}   ),
   IPCCOMMAND(  toggleview,          1,      {ARG_TYPE_UINT}   ),
@@ -536,6 +541,8 @@ static IPCCommand ipccommands[] = {
   IPCCOMMAND(  togglefloating,      1,      {ARG_TYPE_NONE}   ),
   IPCCOMMAND(  setmfact,            1,      {ARG_TYPE_FLOAT}  ),
   IPCCOMMAND(  setlayoutsafe,       1,      {ARG_TYPE_PTR}    ),
-  IPCCOMMAND(  quit,                1,      {ARG_TYPE_NONE}   )
+  IPCCOMMAND(  quit,                1,      {ARG_TYPE_NONE}   ),
+  IPCCOMMAND(  dumptrace,           1,      {ARG_TYPE_NONE}   ),
+  IPCCOMMAND(  xrdb,                1,      {ARG_TYPE_NONE}   )
 };
 
@@ -14,6 +14,11 @@ X11LIB = /usr/lib/X11
 XINERAMALIBS  = -lXinerama
 XINERAMAFLAGS = -DXINERAMA
 
+# XRandR, used for the refresh rate that paces bar redraws, comment if
+# you don't want it
+XRANDRLIBS  = -lXrandr
+XRANDRFLAGS = -DXRANDR
+
 # freetype
 FREETYPELIBS = -lfontconfig -lXft
 FREETYPEINC = /usr/include/freetype2
@@ -29,15 +34,22 @@ YAJLINC = /usr/include/yajl
 
 #KVMLIB = -lkvm
 
+# Chrome trace event recording (dumped on SIGUSR1 or the dumptrace IPC
+# command), uncomment if you want it
+#TRACEFLAGS = -DTRACE
+
+# Client counts used by make bench
+BENCHCLIENTS = 10 100 500
+
 # This is needed for the swallow patch
 XCBLIBS = -lX11-xcb -lxcb -lxcb-res
 
 # includes and libs
 INCS = -I${X11INC} -I${FREETYPEINC} -I${YAJLINC}
-LIBS = -L${X11LIB} -lX11 ${XINERAMALIBS} ${FREETYPELIBS} -lXrender ${IMLIB2LIBS} ${YAJLLIBS} ${XCBLIBS} ${KVMLIB}
+LIBS = -L${X11LIB} -lX11 ${XINERAMALIBS} ${XRANDRLIBS} ${FREETYPELIBS} -lXrender ${IMLIB2LIBS} ${YAJLLIBS} ${XCBLIBS} ${KVMLIB}
 
-# flags
-CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_POSIX_C_SOURCE=200809L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS}
+# flags, _GNU_SOURCE is needed for POSIX_SPAWN_SETSID on glibc
+CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_GNU_SOURCE -D_POSIX_C_SOURCE=200809L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS} ${XRANDRFLAGS} ${TRACEFLAGS}
 #CFLAGS   = -g -std=c99 -pedantic -Wall -O0 ${INCS} ${CPPFLAGS}
 CFLAGS   = -march=native -mtune=native -std=c99 -pedantic -Wall -Wno-deprecated-declarations -Os ${INCS} ${CPPFLAGS}
 LDFLAGS  = ${LIBS}
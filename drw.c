@@ -7,6 +7,7 @@
 #include <Imlib2.h>
 
 #include "drw.h"
+#include "trace.h"
 #include "util.h"
 
 #define UTF_INVALID 0xFFFD
@@ -217,8 +218,8 @@ drw_clr_create(Drw *drw, Clr *dest, const char *clrname, unsigned int alpha)
 	dest->pixel = (dest->pixel & 0x00ffffffU) | (alpha << 24);
 }
 
-/* Wrapper to create color schemes. The caller has to call free(3) on the
- * returned color scheme when done using it. */
+/* Wrapper to create color schemes. The caller has to call drw_scm_free() on
+ * the returned color scheme when done using it. */
 Clr *
 drw_scm_create(Drw *drw, char *clrnames[], unsigned int alphas[], size_t clrcount)
 {
@@ -234,6 +235,18 @@ drw_scm_create(Drw *drw, char *clrnames[], unsigned int alphas[], size_t clrcoun
 	return ret;
 }
 
+void
+drw_scm_free(Drw *drw, Clr *scm, size_t clrcount)
+{
+	size_t i;
+
+	if (!drw || !scm)
+		return;
+	for (i = 0; i < clrcount; i++)
+		XftColorFree(drw->dpy, drw->visual, drw->cmap, &scm[i]);
+	free(scm);
+}
+
 void
 drw_setfontset(Drw *drw, Fnt *set)
 {
@@ -358,6 +371,7 @@ drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lp
 	FcPattern *match;
 	XftResult result;
 	int charexists = 0;
+	TRACE_SCOPE("drw_text");
 
 	if (!drw || (render && !drw->scheme) || !text || !drw->fonts)
 		return 0;
@@ -1,6 +1,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -8,6 +9,7 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 #include <yajl/yajl_gen.h>
 
@@ -42,11 +44,21 @@
     yajl_gen_map_close(gen);                                                   \
   }
 
+#define LENGTH(X) (sizeof X / sizeof X[0])
+
 typedef unsigned long Window;
 
 const char *DEFAULT_SOCKET_PATH = "/tmp/dwm.sock";
 static int sock_fd = -1;
 static unsigned int ignore_reply = 0;
+// In stream mode replies are read by the stream loop, not by the commands
+static unsigned int streaming = 0;
+
+// Subscription filter, see the subscribe command options
+static int filter_monitor = -1;
+static unsigned int filter_tags = 0;
+static Window filter_window = 0;
+static char *filter_fields = NULL;
 
 typedef enum IPCMessageType {
   IPC_TYPE_RUN_COMMAND = 0,
@@ -55,7 +67,10 @@ typedef enum IPCMessageType {
   IPC_TYPE_GET_LAYOUTS = 3,
   IPC_TYPE_GET_DWM_CLIENT = 4,
   IPC_TYPE_SUBSCRIBE = 5,
-  IPC_TYPE_EVENT = 6
+  IPC_TYPE_EVENT = 6,
+  IPC_TYPE_RUN_BATCH = 7,
+  IPC_TYPE_GET_MONITORS_SINCE = 8,
+  IPC_TYPE_GET_STATS = 9
 } IPCMessageType;
 
 // Every IPC message must begin with this
@@ -282,6 +297,8 @@ is_signed_int(const char *s)
 static void
 flush_socket_reply()
 {
+  if (streaming) return;
+
   IPCMessageType reply_type;
   uint32_t reply_size;
   char *reply;
@@ -294,6 +311,8 @@ flush_socket_reply()
 static void
 print_socket_reply()
 {
+  if (streaming) return;
+
   IPCMessageType reply_type;
   uint32_t reply_size;
   char *reply;
@@ -305,14 +324,9 @@ print_socket_reply()
   free(reply);
 }
 
-static int
-run_command(const char *name, char *args[], int argc)
+static void
+gen_command(yajl_gen gen, const char *name, char *args[], int argc)
 {
-  const unsigned char *msg;
-  size_t msg_size;
-
-  yajl_gen gen = yajl_gen_alloc(NULL);
-
   // Message format:
   // {
   //   "command": "<name>",
@@ -336,6 +350,17 @@ run_command(const char *name, char *args[], int argc)
     )
   )
   // clang-format on
+}
+
+static int
+run_command(const char *name, char *args[], int argc)
+{
+  const unsigned char *msg;
+  size_t msg_size;
+
+  yajl_gen gen = yajl_gen_alloc(NULL);
+
+  gen_command(gen, name, args, argc);
 
   yajl_gen_get_buf(gen, &msg, &msg_size);
 
@@ -351,6 +376,48 @@ run_command(const char *name, char *args[], int argc)
   return 0;
 }
 
+/**
+ * Read commands from a file, one per line in the same form as the arguments
+ * of run_command, and send them to dwm as a single batch. Empty lines and
+ * lines starting with '#' are skipped.
+ */
+static int
+run_batch(FILE *f)
+{
+  const unsigned char *msg;
+  size_t msg_size;
+  char *line = NULL;
+  size_t line_size = 0;
+  char *args[64];
+
+  yajl_gen gen = yajl_gen_alloc(NULL);
+
+  yajl_gen_array_open(gen);
+  while (getline(&line, &line_size, f) != -1) {
+    int argc = 0;
+    for (char *tok = strtok(line, " \t\n"); tok && argc < LENGTH(args);
+         tok = strtok(NULL, " \t\n"))
+      args[argc++] = tok;
+    if (argc == 0 || args[0][0] == '#') continue;
+    gen_command(gen, args[0], args + 1, argc - 1);
+  }
+  yajl_gen_array_close(gen);
+  free(line);
+
+  yajl_gen_get_buf(gen, &msg, &msg_size);
+
+  send_message(IPC_TYPE_RUN_BATCH, msg_size, (uint8_t *)msg);
+
+  if (!ignore_reply)
+    print_socket_reply();
+  else
+    flush_socket_reply();
+
+  yajl_gen_free(gen);
+
+  return 0;
+}
+
 static int
 get_monitors()
 {
@@ -359,6 +426,44 @@ get_monitors()
   return 0;
 }
 
+static int
+get_monitors_since(unsigned long seq)
+{
+  const unsigned char *msg;
+  size_t msg_size;
+
+  yajl_gen gen = yajl_gen_alloc(NULL);
+
+  // Message format:
+  // {
+  //   "seq": <seq>
+  // }
+  // clang-format off
+  YMAP(
+    YSTR("seq"); YINT(seq);
+  )
+  // clang-format on
+
+  yajl_gen_get_buf(gen, &msg, &msg_size);
+
+  send_message(IPC_TYPE_GET_MONITORS_SINCE, msg_size, (uint8_t *)msg);
+
+  print_socket_reply();
+
+  yajl_gen_free(gen);
+
+  return 0;
+}
+
+static int
+get_stats()
+{
+  send_message(IPC_TYPE_GET_STATS, 1, (uint8_t *)"");
+  print_socket_reply();
+
+  return 0;
+}
+
 static int
 get_tags()
 {
@@ -417,12 +522,33 @@ subscribe(const char *event)
   // Message format:
   // {
   //   "event": "<event>",
-  //   "action": "subscribe"
+  //   "action": "subscribe",
+  //   "monitor": <monitor number>,      (optional)
+  //   "tags": <tag mask>,               (optional)
+  //   "window_id": <window id>,         (optional)
+  //   "fields": ["<field name>", ...]   (optional)
   // }
   // clang-format off
   YMAP(
     YSTR("event"); YSTR(event);
     YSTR("action"); YSTR("subscribe");
+    if (filter_monitor >= 0) {
+      YSTR("monitor"); YINT(filter_monitor);
+    }
+    if (filter_tags) {
+      YSTR("tags"); YINT(filter_tags);
+    }
+    if (filter_window) {
+      YSTR("window_id"); YINT(filter_window);
+    }
+    if (filter_fields) {
+      YSTR("fields"); YARR(
+        char *fields = strdup(filter_fields);
+        for (char *f = strtok(fields, ","); f; f = strtok(NULL, ","))
+          YSTR(f);
+        free(fields);
+      )
+    }
   )
   // clang-format on
 
@@ -440,6 +566,307 @@ subscribe(const char *event)
   return 0;
 }
 
+/**
+ * Print a message on a single line by dropping the newlines and indentation
+ * of the beautified JSON. Raw newlines can't occur inside JSON strings.
+ */
+static void
+print_message_line(const char *msg, uint32_t size)
+{
+  for (uint32_t i = 0; i < size && msg[i]; i++) {
+    if (msg[i] == '\n') {
+      while (i + 1 < size && (msg[i + 1] == ' ' || msg[i + 1] == '\t')) i++;
+      continue;
+    }
+    putchar(msg[i]);
+  }
+  putchar('\n');
+}
+
+/**
+ * Send the request described by a line of stream input. The line has the
+ * same form as the command line arguments, e.g. "run_command view 2".
+ *
+ * Returns the number of messages sent (and thus replies to expect), -1 on
+ * error
+ */
+static int
+stream_request(char *line, int *subscribed)
+{
+  char *args[64];
+  int argc = 0;
+
+  for (char *tok = strtok(line, " \t"); tok && argc < LENGTH(args);
+       tok = strtok(NULL, " \t"))
+    args[argc++] = tok;
+
+  if (argc == 0 || args[0][0] == '#') return 0;
+
+  if (strcmp(args[0], "run_command") == 0 && argc > 1)
+    run_command(args[1], args + 2, argc - 2);
+  else if (strcmp(args[0], "get_monitors") == 0)
+    get_monitors();
+  else if (strcmp(args[0], "get_monitors_since") == 0 && argc > 1 &&
+           is_unsigned_int(args[1]))
+    get_monitors_since(strtoul(args[1], NULL, 10));
+  else if (strcmp(args[0], "get_tags") == 0)
+    get_tags();
+  else if (strcmp(args[0], "get_stats") == 0)
+    get_stats();
+  else if (strcmp(args[0], "get_layouts") == 0)
+    get_layouts();
+  else if (strcmp(args[0], "get_dwm_client") == 0 && argc > 1 &&
+           is_unsigned_int(args[1]))
+    get_dwm_client(atol(args[1]));
+  else if (strcmp(args[0], "subscribe") == 0 && argc > 1) {
+    for (int i = 1; i < argc; i++) subscribe(args[i]);
+    *subscribed += argc - 1;
+    return argc - 1;
+  } else {
+    fprintf(stderr, "Invalid request '%s'\n", args[0]);
+    return -1;
+  }
+
+  return 1;
+}
+
+/**
+ * Keep one connection open, send newline-delimited requests read from stdin
+ * and stream the replies and subscribed events to stdout, one message per
+ * line. Unless pipeline is set, the next request is only sent once the reply
+ * to the previous one has been received.
+ */
+static int
+stream(int pipeline)
+{
+  char buf[8192];
+  size_t len = 0;
+  int pending = 0, subscribed = 0, eof = 0;
+  struct pollfd fds[] = {{.fd = STDIN_FILENO, .events = POLLIN},
+                         {.fd = sock_fd, .events = POLLIN}};
+
+  streaming = 1;
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  while (!eof || pending > 0 || subscribed || memchr(buf, '\n', len)) {
+    char *nl;
+
+    while ((pipeline || pending <= 0) && (nl = memchr(buf, '\n', len))) {
+      *nl = '\0';
+      int n = stream_request(buf, &subscribed);
+      if (n > 0) pending += n;
+      len -= nl + 1 - buf;
+      memmove(buf, nl + 1, len);
+    }
+
+    if (len == sizeof(buf)) {
+      fputs("Input line too long, discarding it\n", stderr);
+      len = 0;
+    }
+
+    // Stop reading stdin while waiting for a reply in non-pipelined mode
+    fds[0].fd = eof || (!pipeline && pending > 0) ? -1 : STDIN_FILENO;
+
+    if (poll(fds, LENGTH(fds), -1) < 0) {
+      if (errno == EINTR) continue;
+      perror("poll");
+      return 1;
+    }
+
+    if (fds[0].revents & (POLLIN | POLLHUP)) {
+      ssize_t n = read(STDIN_FILENO, buf + len, sizeof(buf) - len);
+      if (n > 0)
+        len += n;
+      else if (n == 0 || errno != EINTR) {
+        eof = 1;
+        // Terminate a trailing line without newline
+        if (len > 0 && len < sizeof(buf)) buf[len++] = '\n';
+      }
+    }
+
+    if (fds[1].revents & POLLIN) {
+      IPCMessageType msg_type;
+      uint32_t msg_size;
+      char *msg;
+
+      read_socket(&msg_type, &msg_size, &msg);
+      if (msg_type != IPC_TYPE_EVENT) pending--;
+      if (msg_type == IPC_TYPE_EVENT || !ignore_reply)
+        print_message_line(msg, msg_size);
+      free(msg);
+    } else if (fds[1].revents & (POLLHUP | POLLERR)) {
+      fputs("The connection to dwm was lost\n", stderr);
+      return 2;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Current monotonic time in microseconds
+ */
+static double
+now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void
+print_latencies(const char *name, double *lat, int n, double elapsed_us)
+{
+  if (n == 0) {
+    printf("%s: no samples\n", name);
+    return;
+  }
+
+  qsort(lat, n, sizeof(double), cmp_double);
+  printf("%s: %d messages in %.3f s, %.0f msg/s\n", name, n, elapsed_us / 1e6,
+         n / (elapsed_us / 1e6));
+  printf("  latency p50 %.1f us, p99 %.1f us, max %.1f us\n",
+         lat[(n - 1) * 50 / 100], lat[(n - 1) * 99 / 100], lat[n - 1]);
+}
+
+/**
+ * Measure how long it takes from running a command until the resulting event
+ * is delivered to a subscriber on another connection. This alternates
+ * "view 0" so the tagset is restored afterwards; it requires the previous
+ * tagset of the selected monitor to differ from the current one.
+ */
+static void
+benchmark_events(int events)
+{
+  int cmd_fd = sock_fd;
+  char view_arg[] = "0";
+  char *view_args[] = {view_arg};
+  double *lat = calloc(events, sizeof(double));
+  int received = 0, lost = 0, late = 0;
+
+  connect_to_socket();
+  int ev_fd = sock_fd;
+  subscribe(IPC_EVENT_TAG_CHANGE);
+
+  struct pollfd pfd = {.fd = ev_fd, .events = POLLIN};
+  double start = now_us();
+
+  for (int i = 0; i < events; i++) {
+    IPCMessageType msg_type;
+    uint32_t msg_size;
+    char *msg;
+    int got = 0;
+
+    sock_fd = cmd_fd;
+    double t0 = now_us();
+    run_command("view", view_args, 1);
+
+    // Events of earlier commands which came after their timeout are
+    // skipped, each command causes exactly one event
+    sock_fd = ev_fd;
+    while (!got) {
+      int left = 1000 - (int)((now_us() - t0) / 1000);
+
+      if (left <= 0 || poll(&pfd, 1, left) <= 0) break;
+      read_socket(&msg_type, &msg_size, &msg);
+      free(msg);
+      if (late > 0)
+        late--;
+      else
+        got = 1;
+    }
+    if (got) {
+      lat[received++] = now_us() - t0;
+    } else {
+      lost++;
+      late++;
+    }
+  }
+
+  print_latencies(IPC_EVENT_TAG_CHANGE, lat, received, now_us() - start);
+  if (lost) printf("  %d events not delivered within 1 s\n", lost);
+
+  close(ev_fd);
+  sock_fd = cmd_fd;
+  free(lat);
+}
+
+/**
+ * Send requests of the given type over concurrency connections, keeping one
+ * request in flight per connection, and report round trip latencies and
+ * throughput. If events is non-zero, also measure event delivery latency.
+ */
+static int
+benchmark(const char *name, IPCMessageType type, int requests,
+          int concurrency, int events)
+{
+  int main_fd = sock_fd;
+  double *sent = calloc(concurrency, sizeof(double));
+  double *lat = calloc(requests, sizeof(double));
+  struct pollfd *pfds = calloc(concurrency, sizeof(struct pollfd));
+  int issued = 0, done = 0;
+
+  for (int i = 0; i < concurrency; i++) {
+    connect_to_socket();
+    pfds[i].fd = sock_fd;
+    pfds[i].events = POLLIN;
+  }
+
+  double start = now_us();
+
+  for (int i = 0; i < concurrency && issued < requests; i++, issued++) {
+    sock_fd = pfds[i].fd;
+    sent[i] = now_us();
+    send_message(type, 1, (uint8_t *)"");
+  }
+
+  while (done < requests) {
+    if (poll(pfds, concurrency, -1) < 0) {
+      if (errno == EINTR) continue;
+      perror("poll");
+      return 1;
+    }
+
+    for (int i = 0; i < concurrency; i++) {
+      if (!(pfds[i].revents & POLLIN)) continue;
+
+      IPCMessageType msg_type;
+      uint32_t msg_size;
+      char *msg;
+
+      sock_fd = pfds[i].fd;
+      read_socket(&msg_type, &msg_size, &msg);
+      free(msg);
+      lat[done++] = now_us() - sent[i];
+
+      if (issued < requests) {
+        sent[i] = now_us();
+        send_message(type, 1, (uint8_t *)"");
+        issued++;
+      }
+    }
+  }
+
+  print_latencies(name, lat, done, now_us() - start);
+
+  for (int i = 0; i < concurrency; i++) close(pfds[i].fd);
+  sock_fd = main_fd;
+  free(sent);
+  free(lat);
+  free(pfds);
+
+  if (events > 0) benchmark_events(events + events % 2);
+
+  return 0;
+}
+
 static void
 usage_error(const char *prog_name, const char *format, ...)
 {
@@ -463,27 +890,60 @@ print_usage(const char *name)
   puts("Commands:");
   puts("  run_command <name> [args...]    Run an IPC command");
   puts("");
+  puts("  batch [file]                    Run the commands in file (or stdin),");
+  puts("                                  one '<name> [args...]' per line,");
+  puts("                                  as a single atomic batch");
+  puts("");
   puts("  get_monitors                    Get monitor properties");
   puts("");
+  puts("  get_monitors_since <seq>        Get monitors and clients changed since");
+  puts("                                  sequence number seq (0 for all)");
+  puts("");
   puts("  get_tags                        Get list of tags");
   puts("");
   puts("  get_layouts                     Get list of layouts");
   puts("");
   puts("  get_dwm_client <window_id>      Get dwm client proprties");
   puts("");
-  puts("  subscribe [events...]           Subscribe to specified events");
+  puts("  get_stats                       Get latency histograms of X event");
+  puts("                                  handlers, IPC commands, layout and");
+  puts("                                  drawing functions and of spawned");
+  puts("                                  commands until their window maps");
+  puts("");
+  puts("  subscribe [filters] [events...] Subscribe to specified events");
   puts("                                  Options: " IPC_EVENT_TAG_CHANGE ",");
   puts("                                  " IPC_EVENT_LAYOUT_CHANGE ",");
   puts("                                  " IPC_EVENT_CLIENT_FOCUS_CHANGE ",");
   puts("                                  " IPC_EVENT_MONITOR_FOCUS_CHANGE ",");
   puts("                                  " IPC_EVENT_FOCUSED_TITLE_CHANGE ",");
   puts("                                  " IPC_EVENT_FOCUSED_STATE_CHANGE);
+  puts("                                  Filters:");
+  puts("                                  --monitor <num>");
+  puts("                                  --tags <mask>");
+  puts("                                  --window <window_id>");
+  puts("                                  --fields <field,...>");
+  puts("");
+  puts("  stream [--pipeline]             Read newline-delimited commands from");
+  puts("                                  stdin over one connection and print");
+  puts("                                  replies and events one per line.");
+  puts("                                  With --pipeline requests are sent");
+  puts("                                  without waiting for replies");
+  puts("");
+  puts("  benchmark [options] [request]   Measure IPC latency and throughput of");
+  puts("                                  get_monitors (default), get_tags or");
+  puts("                                  get_layouts requests");
+  puts("                                  Options:");
+  puts("                                  --requests <n>     (default 10000)");
+  puts("                                  --concurrency <n>  (default 1)");
+  puts("                                  --events <n>       Also measure");
+  puts("                                  tag_change_event delivery latency");
+  puts("                                  by toggling 'view 0' n times");
   puts("");
   puts("  help                            Display this message");
   puts("");
   puts("Options:");
   puts("  --ignore-reply                  Don't print reply messages from");
-  puts("                                  run_command and subscribe.");
+  puts("                                  run_command, batch and subscribe.");
   puts("");
 }
 
@@ -517,8 +977,58 @@ main(int argc, char *argv[])
     // Number of command arguments
     int command_argc = argc - i;
     run_command(command, command_args, command_argc);
+  } else if (strcmp(argv[i], "batch") == 0) {
+    FILE *f = stdin;
+    if (++i < argc && strcmp(argv[i], "-") != 0 && !(f = fopen(argv[i], "r"))) {
+      fprintf(stderr, "Failed to open %s: %s\n", argv[i], strerror(errno));
+      return 1;
+    }
+    run_batch(f);
+    if (f != stdin) fclose(f);
+  } else if (strcmp(argv[i], "stream") == 0) {
+    int pipeline = ++i < argc && strcmp(argv[i], "--pipeline") == 0;
+    return stream(pipeline);
+  } else if (strcmp(argv[i], "benchmark") == 0) {
+    int requests = 10000, concurrency = 1, events = 0;
+    for (++i; i + 1 < argc && strncmp(argv[i], "--", 2) == 0; i += 2) {
+      if (!is_unsigned_int(argv[i + 1]))
+        usage_error(prog_name, "Expected unsigned integer argument");
+      if (strcmp(argv[i], "--requests") == 0)
+        requests = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "--concurrency") == 0)
+        concurrency = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "--events") == 0)
+        events = atoi(argv[i + 1]);
+      else
+        usage_error(prog_name, "Invalid option '%s'", argv[i]);
+    }
+    if (concurrency < 1) usage_error(prog_name, "Concurrency must be >= 1");
+
+    const char *name = i < argc ? argv[i] : "get_monitors";
+    IPCMessageType type = IPC_TYPE_GET_MONITORS;
+    if (strcmp(name, "get_monitors") == 0)
+      type = IPC_TYPE_GET_MONITORS;
+    else if (strcmp(name, "get_tags") == 0)
+      type = IPC_TYPE_GET_TAGS;
+    else if (strcmp(name, "get_layouts") == 0)
+      type = IPC_TYPE_GET_LAYOUTS;
+    else
+      usage_error(prog_name, "Invalid benchmark request '%s'", name);
+
+    ignore_reply = 1;
+    return benchmark(name, type, requests, concurrency, events);
   } else if (strcmp(argv[i], "get_monitors") == 0) {
     get_monitors();
+  } else if (strcmp(argv[i], "get_monitors_since") == 0) {
+    if (++i < argc) {
+      if (is_unsigned_int(argv[i]))
+        get_monitors_since(strtoul(argv[i], NULL, 10));
+      else
+        usage_error(prog_name, "Expected unsigned integer argument");
+    } else
+      usage_error(prog_name, "Expected the sequence number");
+  } else if (strcmp(argv[i], "get_stats") == 0) {
+    get_stats();
   } else if (strcmp(argv[i], "get_tags") == 0) {
     get_tags();
   } else if (strcmp(argv[i], "get_layouts") == 0) {
@@ -533,7 +1043,23 @@ main(int argc, char *argv[])
     } else
       usage_error(prog_name, "Expected the window id");
   } else if (strcmp(argv[i], "subscribe") == 0) {
-    if (++i < argc) {
+    for (++i; i + 1 < argc && strncmp(argv[i], "--", 2) == 0; i += 2) {
+      if (strcmp(argv[i], "--fields") == 0) {
+        filter_fields = argv[i + 1];
+        continue;
+      }
+      if (!is_unsigned_int(argv[i + 1]))
+        usage_error(prog_name, "Expected unsigned integer argument");
+      if (strcmp(argv[i], "--monitor") == 0)
+        filter_monitor = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "--tags") == 0)
+        filter_tags = strtoul(argv[i + 1], NULL, 10);
+      else if (strcmp(argv[i], "--window") == 0)
+        filter_window = strtoul(argv[i + 1], NULL, 10);
+      else
+        usage_error(prog_name, "Invalid filter '%s'", argv[i]);
+    }
+    if (i < argc) {
       for (int j = i; j < argc; j++) subscribe(argv[j]);
     } else
       usage_error(prog_name, "Expected event name");
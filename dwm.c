@@ -21,18 +21,24 @@
  * To understand everything else, start reading main().
  */
 #include <ctype.h> /* for tolower function, very tiny standard library */
+#include <dirent.h>
 #include <errno.h>
 #include <locale.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <limits.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <sys/epoll.h>
 #include <X11/cursorfont.h>
@@ -45,16 +51,23 @@
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif /* XINERAMA */
+#ifdef XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif /* XRANDR */
 #include <X11/Xft/Xft.h>
 #include <Imlib2.h>
 #include <X11/Xlib-xcb.h>
 #include <xcb/res.h>
+#include <xcb/xcbext.h>
 #ifdef __OpenBSD__
 #include <sys/sysctl.h>
 #include <kvm.h>
 #endif /* __OpenBSD */
 
 #include "drw.h"
+#include "proc.h"
+#include "record.h"
+#include "trace.h"
 #include "util.h"
 
 /* macros */
@@ -102,6 +115,9 @@
 
 #define MWM_HINTS_FLAGS_FIELD       0
 #define MWM_HINTS_DECORATIONS_FIELD 2
+#define TEXTPROPLEN 1024 /* in 32 bit units, longer text properties are cut */
+#define CLIENTSLAB 64    /* clients allocated at once, see clientalloc() */
+#define CACHELINE 64
 #define MWM_HINTS_DECORATIONS       (1 << 1)
 #define MWM_DECOR_ALL               (1 << 0)
 #define MWM_DECOR_BORDER            (1 << 1)
@@ -119,6 +135,7 @@ enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMWindowRole, WMLast }; /* d
 enum { ClkTagBar, ClkLtSymbol, ClkStatusText, ClkWinTitle, ClkTopTitle, ClkTabBar, ClkTabClose, ClkTabNext, ClkTabPrev, ClkTabEmpty,
        ClkClientWin, ClkRootWin, ClkLast }; /* clicks */
 enum { ClientRegular = 1, ClientSwallowee, ClientSwallower }; /* client types */
+enum { DamageBar = 1 << 0, DamageTab = 1 << 1 }; /* monitor parts to redraw */
 
 typedef struct TagState TagState;
 struct TagState {
@@ -149,30 +166,42 @@ typedef struct {
 
 typedef struct Monitor Monitor;
 typedef struct Client Client;
+/* Fields are ordered by use: what the layouts and drawbar() read for every
+ * client first, within the first cache line of the client as laid out by
+ * clientalloc(), what is read when the client itself changes next, and
+ * name, size hints, float memory and icon last. */
 struct Client {
-	char name[256];
-	float mina, maxa;
-	float cfact;
+	Client *next;
+	Monitor *mon;
+	Window win;
+	unsigned int tags;
+	int isfloating, isfullscreen, issticky;
 	int x, y, w, h;
-	int sfx, sfy, sfw, sfh; /* stored float geometry, used on mode revert */
+	int bw;
+	float cfact;
+
+	Client *snext;
+	Client *swallowedby;
+	int isfixed, isurgent, neverfocus, oldstate, iscentered, isalwaysontop, canfocus, cantfocus;
+	int oldbw;
 	int oldx, oldy, oldw, oldh;
-	int basew, baseh, incw, inch, maxw, maxh, minw, minh;
-	int bw, oldbw;
-	unsigned int tags;
-	int isfixed, isfloating, isurgent, neverfocus, oldstate, isfullscreen, issticky, iscentered, isalwaysontop, canfocus, cantfocus;
 	pid_t pid;
 	int beingmoved;
 	int floatborderpx;
 	int hasfloatbw;
 	char scratchkey;
 	unsigned int switchtag;
-	unsigned int icw, ich; Picture icon;
-	Client *next;
-	Client *snext;
-	Client *swallowedby;
-	Monitor *mon;
-	Window win;
+	int titlepending;     /* title changed in the current event batch, see updatetitles() */
+	Client *titlenext;
 	ClientState prevstate;
+	uint64_t statehash;   /* see ipc_sync_state_seq() */
+	unsigned long stateseq;
+
+	char name[256];
+	float mina, maxa;
+	int basew, baseh, incw, inch, maxw, maxh, minw, minh;
+	int sfx, sfy, sfw, sfh; /* stored float geometry, used on mode revert */
+	unsigned int icw, ich; Picture icon;
 };
 
 typedef struct {
@@ -194,6 +223,58 @@ typedef struct {
 	void (*arrange)(Monitor *);
 } Layout;
 
+typedef struct {
+	unsigned long events, requests, roundtrips, maxroundtrips;
+} XCallStats;
+
+/* properties manage() requests at once, see propprefetch() */
+enum { PropNetWMName, PropWMName, PropTransient, PropClass, PropRole,
+       PropNetWMState, PropNetWMWindowType, PropNormalHints, PropWMHints,
+       PropMotif, PropIcon, PropLast };
+
+typedef struct {
+	Window win;
+	Atom prop[PropLast], type[PropLast];
+	uint32_t len[PropLast];
+	xcb_get_property_cookie_t cookie[PropLast];
+	int pending[PropLast];
+#ifdef __linux__
+	xcb_res_query_client_ids_cookie_t pid;
+	int pidpending;
+#endif /* __linux__ */
+} PropPrefetch;
+
+/* layout of the _DWM_SESSION property, see savesession(). A header is
+ * followed by SessMons monitor records, each with LENGTH(tags) + 1 per-tag
+ * records, and SessClients client records. Items are 32 bit, floats are
+ * stored as their bit pattern. */
+#define SESSIONVERSION 2
+enum { SessVersion, SessPid, SessNumTags, SessMons, SessClients, SessSelmon, SessHeaderLast };
+enum { SessMonNum, SessMonSeltags, SessMonSellt, SessMonTagset0, SessMonTagset1,
+       SessMonNmaster, SessMonMfact, SessMonShowbar, SessMonLt0, SessMonLt1,
+       SessMonCurtag, SessMonPrevtag, SessMonLast };
+enum { SessTagNmaster, SessTagMfact, SessTagSellt, SessTagLt0, SessTagLt1,
+       SessTagShowbar, SessTagLast };
+enum { SessWin, SessMon, SessClientTags, SessFloating, SessX, SessY, SessW, SessH,
+       SessSfx, SessSfy, SessSfw, SessSfh, SessCfact, SessScratchkey, SessSticky,
+       SessAlwaysontop, SessCanfocus, SessFloatbw, SessHasfloatbw, SessSwallowedby,
+       SessSwallowed, SessStackpos, SessSwitchtag, SessClientLast };
+#define SESSMONLEN (SessMonLast + (LENGTH(tags) + 1) * SessTagLast)
+
+#define STATBUCKETS 32
+#define SPAWNTIMEOUT 10000000000ULL /* ns a spawn may take to map its first window */
+typedef struct {
+	unsigned long count;
+	uint64_t total, max;                /* nanoseconds */
+	unsigned long buckets[STATBUCKETS]; /* bucket i counts [2^i, 2^(i+1)) ns */
+} Histogram;
+
+/* time from spawning a command until its first window is managed */
+typedef struct {
+	char name[32];
+	Histogram latency;
+} SpawnStats;
+
 typedef struct {
 	const char *class;
 	const char *role;
@@ -220,23 +301,51 @@ struct Systray {
 typedef struct Swallow Swallow;
 struct Swallow {
 	/* Window class name, instance name (WM_CLASS) and title
-	 * (WM_NAME/_NET_WM_NAME, latter preferred if it exists). An empty string
-	 * implies a wildcard as per strstr(). */
+	 * (WM_NAME/_NET_WM_NAME, latter preferred if it exists). Class and
+	 * instance have to match exactly, the title may be a substring. An empty
+	 * string implies a wildcard. */
 	char class[256];
 	char inst[256];
 	char title[256];
 
 	/* Used to delete swallow instance after 'swaldecay' windows were mapped
-	 * without the swallow having been consumed. 'decay' keeps track of the
-	 * remaining "charges". */
-	int decay;
+	 * without the swallow having been consumed. The instance expires once
+	 * 'swalmaps' reaches 'expires', see swaldecayby(). */
+	unsigned long expires;
 
 	/* The swallower, i.e. the client which will swallow the next mapped window
 	 * whose filters match the above properties. */
 	Client *client;
 
-	/* Linked list of registered swallow instances. */
+	/* Next instance in the same swalidx bucket, or in swalwild if 'class' is
+	 * empty. */
 	Swallow *next;
+
+	/* All registered swallow instances in order of expiry. */
+	Swallow *qprev, *qnext;
+};
+
+/* Deferred work run from the event loop, owned by its user, see timerset() */
+typedef struct Timer Timer;
+struct Timer {
+	uint64_t when;     /* deadline, nsnow() clock */
+	uint64_t interval; /* ns between runs of a periodic timer, 0 for one-shot */
+	int armed;
+	void (*func)(void *arg);
+	void *arg;
+	Timer *next;
+};
+
+/* Helper program run in the background, see subprocrun() */
+typedef struct Subproc Subproc;
+struct Subproc {
+	int fd;       /* read end of its stdout, or its pidfd if output is not wanted */
+	int capture;
+	char out[1024]; /* output so far, longer output is cut */
+	size_t len;
+	void (*done)(char *out, void *arg);
+	void *arg;
+	Subproc *next;
 };
 
 typedef struct {
@@ -276,6 +385,8 @@ static void buttonpress(XEvent *e);
 static void checkotherwm(void);
 static void cleanup(void);
 static void cleanupmon(Monitor *mon);
+static Client *clientalloc(void);
+static void clientfree(Client *c);
 static void clientmessage(XEvent *e);
 static void configure(Client *c);
 static void configurenotify(XEvent *e);
@@ -289,9 +400,12 @@ static Monitor *dirtomon(int dir);
 static void dragmfact(const Arg *arg);
 static void dragcfact(const Arg *arg);
 static void drawbar(Monitor *m);
+static void drawbarnow(Monitor *m);
 static void drawbars(void);
 static void drawtab(Monitor *m);
+static void drawtabnow(Monitor *m);
 static void drawtabs(void);
+static void dumptrace(const Arg *arg);
 static int cmpint(const void *p1, const void *p2);
 static void drawtaggrid(Monitor *m, int *x_pos, unsigned int occ);
 static void distributetags(const Arg *arg);
@@ -311,26 +425,36 @@ static pid_t getparentprocess(pid_t p);
 static void focuswin(const Arg* arg);
 static Picture geticonprop(Window w, unsigned int *icw, unsigned int *ich);
 static Atom getatomprop(Client *c, Atom prop);
+static void getclasshint(Window w, char *class, char *instance, unsigned int size);
+static xcb_get_property_reply_t *getprop(Window w, Atom prop, Atom type, uint32_t len);
 static int getrootptr(int *x, int *y);
 static long getstate(Window w);
 static pid_t getstatusbarpid();
 static unsigned int getsystraywidth();
 static int gettextprop(Window w, Atom atom, char *text, unsigned int size);
+static Window gettransient(Window w);
 static void goback(const Arg *arg);
 static void grabbuttons(Client *c, int focused);
 static void grabkeys(void);
+static void handlesignals(void);
 static int handlexevent(struct epoll_event *ev);
 static void hide(const Arg *arg);
 static void hidewin(Client *c);
+static void histadd(Histogram *h, uint64_t start);
+static void holdupdates(void);
+static void xcallsadd(int type, unsigned long requests, unsigned long roundtrips);
 static void incnmaster(const Arg *arg);
 static int isdescprocess(pid_t p, pid_t c);
+static int isstatusbar(pid_t pid);
 static void inplacerotate(const Arg *arg);
 static void keypress(XEvent *e);
 static int fake_signal(void);
 static void keyrelease(XEvent *e);
 static void killclient(const Arg *arg);
 static void layoutmenu(const Arg *arg);
+static void layoutmenudone(char *out, void *arg);
 static void killunsel(const Arg *arg);
+static void loadsession(void);
 static void manage(Window w, XWindowAttributes *wa);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
@@ -339,18 +463,28 @@ static void motionnotify(XEvent *e);
 static void moveresize(const Arg *arg);
 static void moveresizeedge(const Arg *arg);
 static void movemouse(const Arg *arg);
+static uint64_t nsnow(void);
 static void moveorplace(const Arg *arg);
 static Client *nexttiled(Client *c);
+#if defined(SYS_pidfd_open) && defined(SYS_pidfd_send_signal)
+static int pidfdqueue(int fd, int sig, union sigval sv);
+#endif
 static void placemouse(const Arg *arg);
 static void opacity(Client *c, double opacity);
 //static void pop(Client *);
 static Client *prevtiled(Client *c);
 static void propertynotify(XEvent *e);
+static void propprefetch(PropPrefetch *pf, Window w);
+static void propprefetchend(PropPrefetch *pf);
 static void pushdown(const Arg *arg);
 static void pushup(const Arg *arg);
 static void quit(const Arg *arg);
 static Client *recttoclient(int x, int y, int w, int h);
 static Monitor *recttomon(int x, int y, int w, int h);
+static void redraw(void *arg);
+static void redrawschedule(void);
+static uint64_t refreshinterval(void);
+static void releaseupdates(void);
 static void reorganizetags(const Arg *arg);
 static void removesystrayicon(Client *i);
 static void resize(Client *c, int x, int y, int w, int h, int interact);
@@ -361,12 +495,16 @@ static void resetcanfocusfloating();
 static void resizemousescroll(const Arg *arg);
 static void resizerequest(XEvent *e);
 static void restack(Monitor *m);
-static int riodraw(Client *c, const char slopstyle[]);
+static void restoresession(void);
+static void riodraw(Client *c, const char slopstyle[]);
+static void riodrawdone(char *out, void *arg);
 static void rioposition(Client *c, int x, int y, int w, int h);
 static void rioresize(const Arg *arg);
 static void riospawn(const Arg *arg);
 static void run(void);
 static void runautostart(void);
+static void runautostartdone(char *out, void *arg);
+static void savesession(void);
 static void scan(void);
 static void scratchpad_hide ();
 static _Bool scratchpad_last_showed_is_killed (void);
@@ -375,6 +513,9 @@ static void scratchpad_show ();
 static void scratchpad_show_client (Client * c);
 static void scratchpad_show_first (void);
 static int sendevent(Window w, Atom proto, int m, long d0, long d1, long d2, long d3, long d4);
+static long sessionfloat(float f);
+static const uint32_t *sessionclient(Window w);
+static float sessionunfloat(uint32_t v);
 static void sendmon(Client *c, Monitor *m);
 static void setborderpx(const Arg *arg);
 static void setclientstate(Client *c, long state);
@@ -392,22 +533,26 @@ static void show(const Arg *arg);
 static void showwin(Client *c);
 static void showhide(Client *c);
 static void showtagpreview(int tag);
-static void sigchld(int unused);
 static void sigstatusbar(const Arg *arg);
-static void sighup(int unused);
-static void sigterm(int unused);
 static void spawn(const Arg *arg);
 static pid_t spawncmd(const Arg *arg);
+static void spawnlatency(Client *c);
+static void spawnreaped(pid_t pid);
+static pid_t spawnprog(char *const argv[]);
 static void tabmode(const Arg *arg);
 static void switchtags(const Arg *arg);
 static void swapclient(const Arg *arg);
 static void swapfocus(const Arg *arg);
 static void spawnscratch(const Arg *arg);
+static Subproc *subprocfind(int fd);
+static void subprochandle(Subproc *p);
+static int subprocrun(const char *cmd, int capture, void (*done)(char *out, void *arg), void *arg);
 static void swal(Client *swer, Client *swee, int manage);
 static void swalreg(Client *c, const char* class, const char* inst, const char* title);
 static void swaldecayby(int decayby);
+static Swallow **swalbucket(const char *class);
 static void swalmanage(Swallow *s, Window w, XWindowAttributes *wa);
-static Swallow *swalmatch(Window w);
+static Swallow *swalmatch(Window w, const char *title);
 static void swalmouse(const Arg *arg);
 static void swalrm(Swallow *s);
 static void swalunreg(Client *c);
@@ -418,6 +563,10 @@ static Monitor *systraytomon(Monitor *m);
 static void tag(const Arg *arg);
 static void tagto(const Arg *arg);
 static void tagmon(const Arg *arg);
+static void timerarm(void);
+static void timerhandle(void);
+static void timerset(Timer *t, uint64_t delay, uint64_t interval, void (*func)(void *arg), void *arg);
+static void timerstop(Timer *t);
 static void togglealttag();
 static void togglebar(const Arg *arg);
 static void togglefloating(const Arg *arg);
@@ -446,7 +595,8 @@ static void updatestatus(void);
 static void updatesystray(void);
 static void updatesystrayicongeom(Client *i, int w, int h);
 static void updatesystrayiconstate(Client *i, XPropertyEvent *ev);
-static void updatetitle(Client *c);
+static int updatetitle(Client *c);
+static void updatetitles(void);
 static void updateicon(Client *c);
 static void updatepreview(void);
 static void updatewindowtype(Client *c);
@@ -458,10 +608,14 @@ static int wintoclient2(Window w, Client **pc, Client **proot);
 static Monitor *wintomon(Window w);
 static void winview(const Arg* arg);
 static Client *wintosystrayicon(Window w);
+static int xafter(Display *dpy);
+static void *xcbreply(unsigned int sequence, xcb_generic_error_t **e);
+static unsigned long xnextrequest(void);
 static int xerror(Display *dpy, XErrorEvent *ee);
 static int xerrordummy(Display *dpy, XErrorEvent *ee);
 static int xerrorstart(Display *dpy, XErrorEvent *ee);
 static void xinitvisual();
+static void xrdb(const Arg *arg);
 static void zoom(const Arg *arg);
 static void load_xresources(void);
 static void resource_load(XrmDatabase db, char *name, enum resource_type rtype, void *dst);
@@ -530,6 +684,7 @@ static int statussig;
 static int statusw;
 static int statusew;
 static pid_t statuspid = -1;
+static int statuspidfd = -1; /* pidfd of statuspid, see sigstatusbar() */
 static int screen;
 static int sw, sh;           /* X display screen geometry width, height */
 static int bh, blw = 0;      /* bar geometry */
@@ -542,6 +697,11 @@ static int (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned int numlockmask = 0;
 static int riodimensions[4] = { -1, -1, -1, -1 };
 static pid_t riopid = 0;
+static int rioselecting = 0;  /* slop is running, see riodrawdone() */
+static Window riowin = None;  /* spawned window mapped while rioselecting */
+static Arg riospawnarg;
+static Subproc *subprocs;
+static uint64_t autostartstart; /* see runautostartdone() */
 static void (*handler[LASTEvent]) (XEvent *) = {
 	[ButtonPress] = buttonpress,
 	[ButtonRelease] = keyrelease,
@@ -562,22 +722,77 @@ static void (*handler[LASTEvent]) (XEvent *) = {
 	[ResizeRequest] = resizerequest,
 	[UnmapNotify] = unmapnotify
 };
+static const char *xeventname[LASTEvent] = {
+	[KeyPress] = "KeyPress", [KeyRelease] = "KeyRelease",
+	[ButtonPress] = "ButtonPress", [ButtonRelease] = "ButtonRelease",
+	[MotionNotify] = "MotionNotify", [EnterNotify] = "EnterNotify",
+	[LeaveNotify] = "LeaveNotify", [FocusIn] = "FocusIn",
+	[FocusOut] = "FocusOut", [KeymapNotify] = "KeymapNotify",
+	[Expose] = "Expose", [GraphicsExpose] = "GraphicsExpose",
+	[NoExpose] = "NoExpose", [VisibilityNotify] = "VisibilityNotify",
+	[CreateNotify] = "CreateNotify", [DestroyNotify] = "DestroyNotify",
+	[UnmapNotify] = "UnmapNotify", [MapNotify] = "MapNotify",
+	[MapRequest] = "MapRequest", [ReparentNotify] = "ReparentNotify",
+	[ConfigureNotify] = "ConfigureNotify", [ConfigureRequest] = "ConfigureRequest",
+	[GravityNotify] = "GravityNotify", [ResizeRequest] = "ResizeRequest",
+	[CirculateNotify] = "CirculateNotify", [CirculateRequest] = "CirculateRequest",
+	[PropertyNotify] = "PropertyNotify", [SelectionClear] = "SelectionClear",
+	[SelectionRequest] = "SelectionRequest", [SelectionNotify] = "SelectionNotify",
+	[ColormapNotify] = "ColormapNotify", [ClientMessage] = "ClientMessage",
+	[MappingNotify] = "MappingNotify", [GenericEvent] = "GenericEvent"
+};
+/* handler latencies, see histadd() */
+static Histogram eventstats[LASTEvent];
+static Histogram arrangestats, drawbarstats, restackstats;
+static SpawnStats spawnstats[32];
+static unsigned int spawnstatslen;
+static struct {
+	pid_t pid;
+	uint64_t start;
+	SpawnStats *stats;
+} spawnpending[16]; /* spawns without a window yet, see spawnlatency() */
+/* X requests and round trips per handled event type, see xafter() */
+static XCallStats xcallstats[LASTEvent];
+static unsigned long xroundtrips = 0, xlastread = 0;
+static unsigned int xcbseq = 0; /* last request sent through XCB, see xnextrequest() */
 static Atom wmatom[WMLast], netatom[NetLast], xatom[XLast], motifatom;
 static int epoll_fd;
 static int dpy_fd;
+static int proc_fd = -1; /* process connector, see proc.h */
+static int signal_fd = -1;
+static int timer_fd = -1;
+static Timer *timers;        /* armed timers by deadline, see timerset() */
+static Timer redrawtimer;    /* flushes the damaged bars and tabs, see drawbar() */
+static uint64_t frameinterval, lastredraw; /* ns, see redrawschedule() */
+#ifdef XRANDR
+static int rrevbase = -1;    /* first XRandR event, see handlexevent() */
+#endif /* XRANDR */
 static int restart = 0;
 static int running = 1;
+static sigset_t sigmask;     /* signals handled through signal_fd */
+static int updateshold = 0;  /* arrange is deferred while > 0 */
+static Client *titlequeue;   /* clients with titlepending set */
+static Client *clientpool;   /* unused clients, see clientalloc() */
 static Cur *cursor[CurLast];
 static Clr **scheme;
 static Clr **tagscheme;
 static Display *dpy;
 static Drw *drw;
 static Monitor *mons, *selmon, *lastselmon, *prevmon;
-static Swallow *swallows;
+static Swallow *swallows, *swallowslast; /* in order of expiry */
+static Swallow *swalidx[64];  /* by class name, see swalbucket() */
+static Swallow *swalwild;     /* without class filter */
+static unsigned long swalmaps; /* windows mapped so far, for decay */
+static struct {
+	Window win;
+	char class[256], inst[256];
+} swalcand; /* WM_CLASS of the last window swalmatch() looked at */
 static Window root, wmcheckwin;
 static Client *mark;
 static KeySym keychain = -1;
 static xcb_connection_t *xcon;
+static PropPrefetch *prefetch = NULL; /* replies pending for the window being managed */
+static xcb_get_property_reply_t *session = NULL; /* state saved before a restart, see loadsession() */
 
 static int useargb = 0;
 static Visual *visual;
@@ -615,11 +830,37 @@ static IPCClientList ipc_clients = NULL;
 static int epoll_fd = -1;
 static int sock_fd = -1;
 static IPCCommand *ipc_commands;
+static Histogram *ipc_command_stats;
 static unsigned int ipc_commands_len;
 // Max size is 1 MB
 static const uint32_t MAX_MESSAGE_SIZE = 1000000;
 static const int IPC_SOCKET_BACKLOG = 5;
 
+// State sequence numbers and removed client tombstones for
+// IPC_TYPE_GET_MONITORS_SINCE, see ipc_sync_state_seq
+#define IPC_TOMBSTONES 128
+static unsigned long ipc_state_seq = 0;
+static struct {
+  Window win;
+  unsigned long seq;
+} ipc_tombstones[IPC_TOMBSTONES];
+static unsigned long ipc_tombstones_len = 0;
+// Oldest sequence number deltas can be given for, see ipc_init
+static unsigned long ipc_tombstones_dropped = 0;
+
+/**
+ * Properties of an event that are matched against the subscription filters of
+ * IPC clients before the event is serialized. Unused monitor slots are -1,
+ * unused window slots and tags are 0 and fields is 0 for events without
+ * fields.
+ */
+typedef struct IPCEventContext {
+  int mon_num[2];
+  Window win[2];
+  unsigned int tags;
+  unsigned int fields;
+} IPCEventContext;
+
 #define MAXTABS 50
 
 typedef struct Pertag Pertag;
@@ -668,6 +909,10 @@ struct Monitor {
 	Window tagwin;
 	int previewshow;
 	Pixmap tagmap[LENGTH(tags)];
+	int arrangepending;   /* arrange deferred by holdupdates() */
+	int damage;           /* Damage* parts to redraw, see drawbar() */
+	uint64_t statehash;   /* see ipc_sync_state_seq() */
+	unsigned long stateseq;
 };
 
 struct Pertag {
@@ -723,11 +968,10 @@ void
 applyrules(Client *c)
 {
 	const char *class, *instance;
-	char role[64];
+	char role[64], classbuf[256], instancebuf[256];
 	unsigned int i, newtagset;
 	const Rule *r;
 	Monitor *m;
-	XClassHint ch = { NULL, NULL };
 
 	/* rule matching */
 	c->iscentered = 0;
@@ -735,9 +979,9 @@ applyrules(Client *c)
 	c->tags = 0;
 	c->scratchkey = 0;
     	c->canfocus = 1;
-	XGetClassHint(dpy, c->win, &ch);
-	class    = ch.res_class ? ch.res_class : broken;
-	instance = ch.res_name  ? ch.res_name  : broken;
+	getclasshint(c->win, classbuf, instancebuf, sizeof(classbuf));
+	class    = classbuf[0]    ? classbuf    : broken;
+	instance = instancebuf[0] ? instancebuf : broken;
 	gettextprop(c->win, wmatom[WMWindowRole], role, sizeof(role));
 
 	for (i = 0; i < LENGTH(rules); i++) {
@@ -787,10 +1031,6 @@ applyrules(Client *c)
 			}
 		}
 	}
-	if (ch.res_class)
-		XFree(ch.res_class);
-	if (ch.res_name)
-		XFree(ch.res_name);
 	if (c->tags != SCRATCHPAD_MASK) {
 		if(c->tags & TAGMASK)                    c->tags = c->tags & TAGMASK;
 		else if(c->mon->tagset[c->mon->seltags]) c->tags = c->mon->tagset[c->mon->seltags];
@@ -867,6 +1107,15 @@ applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact)
 void
 arrange(Monitor *m)
 {
+	TRACE_SCOPE("arrange");
+	if (updateshold) {
+		if (m)
+			m->arrangepending = 1;
+		else for (m = mons; m; m = m->next)
+			m->arrangepending = 1;
+		return;
+	}
+	uint64_t start = nsnow();
 	if (m)
 		showhide(m->stack);
 	else for (m = mons; m; m = m->next)
@@ -876,6 +1125,7 @@ arrange(Monitor *m)
 		restack(m);
 	} else for (m = mons; m; m = m->next)
 		arrangemon(m);
+	histadd(&arrangestats, start);
 }
 
 void
@@ -1229,7 +1479,8 @@ cleanup(void)
 	for (i = 0; i < CurLast; i++)
 		drw_cur_free(drw, cursor[i]);
 	for (i = 0; i < LENGTH(colors) + 1; i++)
-		free(scheme[i]);
+		drw_scm_free(drw, scheme[i], 4);
+	free(scheme);
 	XDestroyWindow(dpy, wmcheckwin);
 	drw_free(drw);
 	XSync(dpy, False);
@@ -1237,6 +1488,10 @@ cleanup(void)
 	XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
 
 	ipc_cleanup();
+	procclose();
+	if (statuspidfd >= 0)
+		close(statuspidfd);
+	close(timer_fd);
 
 	if (close(epoll_fd) < 0) {
 			fprintf(stderr, "Failed to close epoll file descriptor\n");
@@ -1268,6 +1523,46 @@ cleanupmon(Monitor *mon)
 	free(mon);
 }
 
+/* Returns a zeroed client. Clients are carved from slabs of CLIENTSLAB, so
+ * that walking the client lists stays within a few pages, and are reused
+ * after clientfree() instead of being returned to malloc. Each client starts
+ * on a cache line. */
+Client *
+clientalloc(void)
+{
+	size_t size = (sizeof(Client) + CACHELINE - 1) / CACHELINE * CACHELINE;
+	Client *c;
+	void *slab;
+	int i;
+
+	if (!clientpool) {
+		if (posix_memalign(&slab, CACHELINE, CLIENTSLAB * size))
+			die("fatal: could not malloc() %zu bytes\n", CLIENTSLAB * size);
+		for (i = CLIENTSLAB - 1; i >= 0; i--) {
+			c = (Client *)((char *)slab + i * size);
+			c->next = clientpool;
+			clientpool = c;
+		}
+	}
+	c = clientpool;
+	clientpool = c->next;
+	memset(c, 0, sizeof(Client));
+	return c;
+}
+
+void
+clientfree(Client *c)
+{
+	Client **pc;
+
+	if (c->titlepending) {
+		for (pc = &titlequeue; *pc != c; pc = &(*pc)->titlenext);
+		*pc = c->titlenext;
+	}
+	c->next = clientpool;
+	clientpool = c;
+}
+
 void
 clientmessage(XEvent *e)
 {
@@ -1279,10 +1574,9 @@ clientmessage(XEvent *e)
 	if (showsystray && cme->window == systray->win && cme->message_type == netatom[NetSystemTrayOP]) {
 		/* add systray icons */
 		if (cme->data.l[1] == SYSTEM_TRAY_REQUEST_DOCK) {
-			if (!(c = (Client *)calloc(1, sizeof(Client))))
-				die("fatal: could not malloc() %u bytes\n", sizeof(Client));
+			c = clientalloc();
 			if (!(c->win = cme->data.l[2])) {
-				free(c);
+				clientfree(c);
 				return;
 			}
 			c->mon = selmon;
@@ -1542,7 +1836,7 @@ destroynotify(XEvent *e)
 		for (swee = root; swee->swallowedby != c; swee = swee->swallowedby);
 		swee->swallowedby = NULL;
 
-		free(c);
+		clientfree(c);
 		updateclientlist();
 		break;
 	}
@@ -1624,6 +1918,7 @@ dirtomon(int dir)
 
 int
 drawstatusbar(Monitor *m, int bh, char* stext, int extra) {
+	TRACE_SCOPE("drawstatusbar");
 	int ret, i, j, w, x, len;
 	short isCode = 0;
 	char *text;
@@ -2043,9 +2338,19 @@ dragmfact(const Arg *arg)
 	while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
 }
 
+/* Marks the bar of m for redrawing. Redraws are done by redraw() at most
+ * once per frame, so bursts of status and title updates cost one redraw. */
 void
 drawbar(Monitor *m)
 {
+	m->damage |= DamageBar;
+	redrawschedule();
+}
+
+void
+drawbarnow(Monitor *m)
+{
+	TRACE_SCOPE("drawbar");
 	int indn;
 	int x, w, tw = 0, stw = 0, etw = 0, n = 0, scm;
 	int boxs = drw->fonts->h / 9;
@@ -2057,6 +2362,7 @@ drawbar(Monitor *m)
 	char alttagdisp[64];
 	char *altmasterclientontag[LENGTH(tags)];
 	Fnt *cur;
+	uint64_t start = nsnow();
 
 	if(showsystray && m == systraytomon(m) && !systrayonleft)
 		stw = getsystraywidth();
@@ -2229,6 +2535,7 @@ drawbar(Monitor *m)
 		m->btw = w;
 		drw_map(drw, m->extrabarwin, 0, 0, m->ww, bh);
 	}
+	histadd(&drawbarstats, start);
 }
 
 void
@@ -2312,6 +2619,12 @@ cmpint(const void *p1, const void *p2) {
 
 void
 drawtab(Monitor *m) {
+	m->damage |= DamageTab;
+	redrawschedule();
+}
+
+void
+drawtabnow(Monitor *m) {
 	Client *c;
 	int i;
 	int itag = -1;
@@ -2425,6 +2738,12 @@ drawtab(Monitor *m) {
 	drw_map(drw, m->tabwin, 0, 0, m->ww, th);
 }
 
+void
+dumptrace(const Arg *arg)
+{
+	if (tracedump(tracefile) < 0)
+		fprintf(stderr, "dwm: cannot write trace to %s\n", tracefile);
+}
 
 void
 enternotify(XEvent *e)
@@ -2712,48 +3031,109 @@ focuswin(const Arg* arg){
 Atom
 getatomprop(Client *c, Atom prop)
 {
-	int di;
-	unsigned long dl;
-	unsigned char *p = NULL;
-	Atom da, atom = None;
+	xcb_get_property_reply_t *r;
+	uint32_t *p;
+	Atom atom = None;
 	/* FIXME getatomprop should return the number of items and a pointer to
 	 * the stored data instead of this workaround */
 	Atom req = XA_ATOM;
 	if (prop == xatom[XembedInfo])
 		req = xatom[XembedInfo];
 
-	if (XGetWindowProperty(dpy, c->win, prop, 0L, sizeof atom, False, req,
-		&da, &di, &dl, &dl, &p) == Success && p) {
-		atom = *(Atom *)p;
-		if (da == xatom[XembedInfo] && dl == 2)
-			atom = ((Atom *)p)[1];
-		XFree(p);
+	if ((r = getprop(c->win, prop, req, 2))) {
+		p = xcb_get_property_value(r);
+		if (r->format == 32 && r->value_len > 0) {
+			atom = p[0];
+			if (r->type == xatom[XembedInfo] && r->value_len == 2)
+				atom = p[1];
+		}
+		free(r);
 	}
 	return atom;
 }
 
+/* Reads the class and instance names from WM_CLASS, leaving them empty if the
+ * property is not set */
+void
+getclasshint(Window w, char *class, char *instance, unsigned int size)
+{
+	xcb_get_property_reply_t *r;
+	const char *v;
+	int len, n;
+
+	class[0] = instance[0] = '\0';
+	if (!(r = getprop(w, XA_WM_CLASS, XA_STRING, TEXTPROPLEN)))
+		return;
+	if (r->format == 8) {
+		v = xcb_get_property_value(r);
+		len = xcb_get_property_value_length(r);
+		n = strnlen(v, len);
+		snprintf(instance, size, "%.*s", n, v);
+		if (n + 1 < len)
+			snprintf(class, size, "%.*s", (int)strnlen(v + n + 1, len - n - 1), v + n + 1);
+	}
+	free(r);
+}
+
+/* Returns the reply to a GetProperty request, to be freed by the caller. If
+ * manage() prefetched the property with the same type and length the pending
+ * reply is used, otherwise the property is requested now. */
+xcb_get_property_reply_t *
+getprop(Window w, Atom prop, Atom type, uint32_t len)
+{
+	int i;
+
+	if (prefetch && prefetch->win == w)
+		for (i = 0; i < PropLast; i++)
+			if (prefetch->pending[i] && prefetch->prop[i] == prop
+			&& prefetch->type[i] == type && prefetch->len[i] == len) {
+				prefetch->pending[i] = 0;
+				return xcbreply(prefetch->cookie[i].sequence, NULL);
+			}
+	xcbseq = xcb_get_property(xcon, 0, w, prop, type, 0, len).sequence;
+	return xcbreply(xcbseq, NULL);
+}
+
+/* Returns whether argv[0] of process pid is STATUSBAR, ignoring the path */
+int
+isstatusbar(pid_t pid)
+{
+	char buf[256], *str = buf, *c;
+	ssize_t n;
+	int fd;
+
+	snprintf(buf, sizeof(buf), "/proc/%u/cmdline", (unsigned)pid);
+	if ((fd = open(buf, O_RDONLY | O_CLOEXEC)) < 0)
+		return 0;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return 0;
+	buf[n] = '\0';
+	while ((c = strchr(str, '/')))
+		str = c + 1;
+	return !strcmp(str, STATUSBAR);
+}
+
+/* Looks up the status bar in /proc, without running pidof */
 pid_t
 getstatusbarpid()
 {
-	char buf[32], *str = buf, *c;
-	FILE *fp;
-
-	if (statuspid > 0) {
-		snprintf(buf, sizeof(buf), "/proc/%u/cmdline", statuspid);
-		if ((fp = fopen(buf, "r"))) {
-			fgets(buf, sizeof(buf), fp);
-			while ((c = strchr(str, '/')))
-				str = c + 1;
-			fclose(fp);
-			if (!strcmp(str, STATUSBAR))
-				return statuspid;
-		}
-	}
-	if (!(fp = popen("pidof -s "STATUSBAR, "r")))
+	DIR *dir;
+	struct dirent *de;
+	pid_t pid = -1;
+
+	if (statuspid > 0 && isstatusbar(statuspid))
+		return statuspid;
+	if (!(dir = opendir("/proc")))
 		return -1;
-	fgets(buf, sizeof(buf), fp);
-	pclose(fp);
-	return strtoul(buf, NULL, 10);
+	while ((de = readdir(dir)))
+		if (isdigit((unsigned char)de->d_name[0]) && isstatusbar(atoi(de->d_name))) {
+			pid = atoi(de->d_name);
+			break;
+		}
+	closedir(dir);
+	return pid;
 }
 
 static uint32_t prealpha(uint32_t p) {
@@ -2766,36 +3146,36 @@ static uint32_t prealpha(uint32_t p) {
 Picture
 geticonprop(Window win, unsigned int *picw, unsigned int *pich)
 {
-	int format;
-	unsigned long n, extra, *p = NULL;
-	Atom real;
+	TRACE_SCOPE("geticonprop");
+	xcb_get_property_reply_t *r;
+	uint32_t n, *p;
 
-	if (XGetWindowProperty(dpy, win, netatom[NetWMIcon], 0L, LONG_MAX, False, AnyPropertyType, 
-						   &real, &format, &n, &extra, (unsigned char **)&p) != Success)
-		return None; 
-	if (n == 0 || format != 32) { XFree(p); return None; }
+	if (!(r = getprop(win, netatom[NetWMIcon], AnyPropertyType, UINT32_MAX)))
+		return None;
+	p = xcb_get_property_value(r);
+	if ((n = r->value_len) == 0 || r->format != 32) { free(r); return None; }
 
-	unsigned long *bstp = NULL;
+	uint32_t *bstp = NULL;
 	uint32_t w, h, sz;
 	{
-		unsigned long *i; const unsigned long *end = p + n;
+		uint32_t *i; const uint32_t *end = p + n;
 		uint32_t bstd = UINT32_MAX, d, m;
 		for (i = p; i < end - 1; i += sz) {
-			if ((w = *i++) > UINT16_MAX || (h = *i++) > UINT16_MAX) { XFree(p); return None; }
+			if ((w = *i++) > UINT16_MAX || (h = *i++) > UINT16_MAX) { free(r); return None; }
 			if ((sz = w * h) > end - i) break;
 			if ((m = w > h ? w : h) >= ICONSIZE && (d = m - ICONSIZE) < bstd) { bstd = d; bstp = i; }
 		}
 		if (!bstp) {
 			for (i = p; i < end - 1; i += sz) {
-				if ((w = *i++) > UINT16_MAX || (h = *i++) > UINT16_MAX) { XFree(p); return None; }
+				if ((w = *i++) > UINT16_MAX || (h = *i++) > UINT16_MAX) { free(r); return None; }
 				if ((sz = w * h) > end - i) break;
 				if ((d = ICONSIZE - (w > h ? w : h)) < bstd) { bstd = d; bstp = i; }
 			}
 		}
-		if (!bstp) { XFree(p); return None; }
+		if (!bstp) { free(r); return None; }
 	}
 
-	if ((w = *(bstp - 2)) == 0 || (h = *(bstp - 1)) == 0) { XFree(p); return None; }
+	if ((w = *(bstp - 2)) == 0 || (h = *(bstp - 1)) == 0) { free(r); return None; }
 
 	uint32_t icw, ich;
 	if (w <= h) {
@@ -2808,11 +3188,11 @@ geticonprop(Window win, unsigned int *picw, unsigned int *pich)
 	}
 	*picw = icw; *pich = ich;
 
-	uint32_t i, *bstp32 = (uint32_t *)bstp;
-	for (sz = w * h, i = 0; i < sz; ++i) bstp32[i] = prealpha(bstp[i]);
+	uint32_t i;
+	for (sz = w * h, i = 0; i < sz; ++i) bstp[i] = prealpha(bstp[i]);
 
 	Picture ret = drw_picture_create_resized(drw, (char *)bstp, w, h, icw, ich);
-	XFree(p);
+	free(r);
 
 	return ret;
 }
@@ -2823,15 +3203,7 @@ getparentprocess(pid_t p)
 	unsigned int v = 0;
 
 #ifdef __linux__
-	FILE *f;
-	char buf[256];
-	snprintf(buf, sizeof(buf) - 1, "/proc/%u/stat", (unsigned)p);
-
-	if (!(f = fopen(buf, "r")))
-		return 0;
-
-	fscanf(f, "%*u %*s %*c %u", &v);
-	fclose(f);
+	v = procparent(p);
 #endif /* __linux__*/
 
 #ifdef __OpenBSD__
@@ -2894,14 +3266,23 @@ gettextprop(Window w, Atom atom, char *text, unsigned int size)
 	char **list = NULL;
 	int n;
 	XTextProperty name;
+	xcb_get_property_reply_t *r;
 
 	if (!text || size == 0)
 		return 0;
 	text[0] = '\0';
-	if (!XGetTextProperty(dpy, w, &name, atom) || !name.nitems)
+	if (!(r = getprop(w, atom, AnyPropertyType, TEXTPROPLEN)))
+		return 0;
+	if (!r->value_len) {
+		free(r);
 		return 0;
+	}
+	name.value = xcb_get_property_value(r);
+	name.encoding = r->type;
+	name.format = r->format;
+	name.nitems = r->value_len;
 	if (name.encoding == XA_STRING)
-		strncpy(text, (char *)name.value, size - 1);
+		snprintf(text, size, "%.*s", xcb_get_property_value_length(r), (char *)name.value);
 	else {
 		if (XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && n > 0 && *list) {
 			strncpy(text, *list, size - 1);
@@ -2909,10 +3290,25 @@ gettextprop(Window w, Atom atom, char *text, unsigned int size)
 		}
 	}
 	text[size - 1] = '\0';
-	XFree(name.value);
+	free(r);
 	return 1;
 }
 
+/* Returns the window w is transient for, or None */
+Window
+gettransient(Window w)
+{
+	xcb_get_property_reply_t *r;
+	Window trans = None;
+
+	if ((r = getprop(w, XA_WM_TRANSIENT_FOR, XA_WINDOW, 1))) {
+		if (r->type == XA_WINDOW && r->format == 32 && r->value_len)
+			trans = *(uint32_t *)xcb_get_property_value(r);
+		free(r);
+	}
+	return trans;
+}
+
 void
 goback(const Arg *arg)
 {
@@ -3005,6 +3401,40 @@ hidewin(Client *c) {
 	arrange(c->mon);
 }
 
+/* Reads the signals queued on signal_fd:
+ *   SIGCHLD  reaps the children
+ *   SIGHUP   restarts
+ *   SIGTERM  quits
+ *   SIGUSR1  writes the trace, see dumptrace()
+ *   SIGUSR2  reloads the X resources, see xrdb() */
+void
+handlesignals(void)
+{
+	struct signalfd_siginfo si;
+	pid_t pid;
+
+	while (read(signal_fd, &si, sizeof(si)) == sizeof(si)) {
+		switch (si.ssi_signo) {
+		case SIGCHLD:
+			while (0 < (pid = waitpid(-1, NULL, WNOHANG)))
+				spawnreaped(pid);
+			break;
+		case SIGHUP:
+			quit(&((Arg) { .i = 1 }));
+			break;
+		case SIGTERM:
+			quit(&((Arg) { .i = 0 }));
+			break;
+		case SIGUSR1:
+			dumptrace(NULL);
+			break;
+		case SIGUSR2:
+			xrdb(NULL);
+			break;
+		}
+	}
+}
+
 int
 handlexevent(struct epoll_event *ev)
 {
@@ -3012,11 +3442,30 @@ handlexevent(struct epoll_event *ev)
 		XEvent ev;
 		while (running && XPending(dpy)) {
 			XNextEvent(dpy, &ev);
+#ifdef XRANDR
+			/* the refresh rate can change without the root size */
+			if (ev.type == rrevbase + RRScreenChangeNotify) {
+				XRRUpdateConfiguration(&ev);
+				frameinterval = refreshinterval();
+				continue;
+			}
+#endif /* XRANDR */
 			if (handler[ev.type]) {
+				TRACE_SCOPE(xeventname[ev.type] ? xeventname[ev.type] : "unknown");
+				if (recording)
+					recordxevent(dpy, &ev);
+				uint64_t start = nsnow();
+				unsigned long req = xnextrequest(), rt = xroundtrips;
 				handler[ev.type](&ev); /* call handler */
+				histadd(&eventstats[ev.type], start);
+				xcallsadd(ev.type, xnextrequest() - req, xroundtrips - rt);
 				ipc_send_events(mons, &lastselmon, selmon);
 			}
 		}
+		if (titlequeue) {
+			updatetitles();
+			ipc_send_events(mons, &lastselmon, selmon);
+		}
 	} else if (ev-> events & EPOLLHUP) {
 		return -1;
 	}
@@ -3024,6 +3473,51 @@ handlexevent(struct epoll_event *ev)
 	return 0;
 }
 
+/* Accounts the X requests and round trips made while handling an event of
+ * the given type. Debug builds flag handlers exceeding roundtripbudget. */
+void
+xcallsadd(int type, unsigned long requests, unsigned long roundtrips)
+{
+	XCallStats *s = &xcallstats[type];
+
+	s->events++;
+	s->requests += requests;
+	s->roundtrips += roundtrips;
+	if (roundtrips > s->maxroundtrips)
+		s->maxroundtrips = roundtrips;
+	DEBUG("%s: %lu requests, %lu round trips\n", xeventname[type], requests, roundtrips);
+#ifdef _DEBUG
+	if (roundtripbudget && roundtrips > roundtripbudget)
+		fprintf(stderr, "dwm: %s handler made %lu round trips, budget is %u\n",
+			xeventname[type], roundtrips, roundtripbudget);
+#endif
+}
+
+/* Records the time elapsed since start, as returned by nsnow(), in a
+ * log2-bucketed latency histogram. */
+void
+histadd(Histogram *h, uint64_t start)
+{
+	uint64_t ns = nsnow() - start;
+	int i;
+
+	for (i = 0; i < STATBUCKETS - 1 && ns >> (i + 1); i++);
+	h->buckets[i]++;
+	h->count++;
+	h->total += ns;
+	if (ns > h->max)
+		h->max = ns;
+}
+
+/* Defers arrange() until the matching releaseupdates(), so that a sequence
+ * of commands results in a single relayout. Bars and tabs are redrawn once
+ * per frame anyway, see drawbar(). */
+void
+holdupdates(void)
+{
+	updateshold++;
+}
+
 void
 incnmaster(const Arg *arg)
 {
@@ -3189,30 +3683,37 @@ killunsel(const Arg *arg)
 
 void
 layoutmenu(const Arg *arg) {
-	FILE *p;
-	char c[3], *s;
+	subprocrun(layoutmenu_cmd, 1, layoutmenudone, NULL);
+}
+
+/* Sets the layout chosen in the menu, if any */
+void
+layoutmenudone(char *out, void *arg) {
 	int i;
 
-	if (!(p = popen(layoutmenu_cmd, "r")))
+	if (!out || *out == '\0')
 		 return;
-	s = fgets(c, sizeof(c), p);
-	pclose(p);
 
-	if (!s || *s == '\0' || c == '\0')
+	i = atoi(out);
+	if (i < 0 || i >= LENGTH(layouts))
 		 return;
-
-	i = atoi(c);
 	setlayout(&((Arg) { .v = &layouts[i] }));
 }
 
 void
 manage(Window w, XWindowAttributes *wa)
 {
+	TRACE_SCOPE("manage");
 	Client *c, *t = NULL;
 	Window trans = None;
 	XWindowChanges wc;
+	PropPrefetch pf;
+	const uint32_t *sc = sessionclient(w);
 
-	c = ecalloc(1, sizeof(Client));
+	/* send all property requests at once, the helpers below take the
+	 * replies as they need them */
+	propprefetch(&pf, w);
+	c = clientalloc();
 	c->win = w;
 	c->pid = winpid(w);
 	/* geometry */
@@ -3225,7 +3726,27 @@ manage(Window w, XWindowAttributes *wa)
 
 	updateicon(c);
 	updatetitle(c);
-	if (XGetTransientForHint(dpy, w, &trans) && (t = wintoclient(trans))) {
+	trans = gettransient(w);
+	if (sc) {
+		/* restarted, put the client back where it was instead of
+		 * evaluating the rules again */
+		for (c->mon = mons; c->mon && c->mon->num != (int)sc[SessMon]; c->mon = c->mon->next);
+		if (!c->mon)
+			c->mon = selmon;
+		c->tags = sc[SessClientTags];
+		c->isfloating = sc[SessFloating];
+		c->x = (int32_t)sc[SessX];
+		c->y = (int32_t)sc[SessY];
+		c->w = sc[SessW];
+		c->h = sc[SessH];
+		c->scratchkey = sc[SessScratchkey];
+		c->issticky = sc[SessSticky];
+		c->isalwaysontop = sc[SessAlwaysontop];
+		c->canfocus = sc[SessCanfocus];
+		c->floatborderpx = sc[SessFloatbw];
+		c->hasfloatbw = sc[SessHasfloatbw];
+		c->switchtag = sc[SessSwitchtag];
+	} else if (trans && (t = wintoclient(trans))) {
 		c->mon = t->mon;
 		c->tags = t->tags;
 	} else {
@@ -3234,12 +3755,13 @@ manage(Window w, XWindowAttributes *wa)
 	}
 
 	if (unmanaged) {
+		propprefetchend(&pf);
 		XMapWindow(dpy, c->win);
 		if (unmanaged == 1)
 			XRaiseWindow(dpy, c->win);
 		else if (unmanaged == 2)
 			XLowerWindow(dpy, c->win);
-		free(c);
+		clientfree(c);
 		unmanaged = 0;
 		return;
 	}
@@ -3265,6 +3787,7 @@ manage(Window w, XWindowAttributes *wa)
 	updatesizehints(c);
 	updatewmhints(c);
 	updatemotifhints(c);
+	propprefetchend(&pf);
 	if (c->iscentered) {
 		c->x = c->mon->mx + (c->mon->mw - WIDTH(c)) / 2;
 		c->y = c->mon->my + (c->mon->mh - HEIGHT(c)) / 2;
@@ -3284,7 +3807,7 @@ manage(Window w, XWindowAttributes *wa)
 	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
 		(unsigned char *) &(c->win), 1);
 	XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h); /* some windows require this */
-	if (!HIDDEN(c))
+	if (!HIDDEN(c) && !(sc && sc[SessSwallowed]))
 		setclientstate(c, NormalState);
 	if (c->mon == selmon) {
 		unfocus(selmon->sel, 0);
@@ -3292,7 +3815,11 @@ manage(Window w, XWindowAttributes *wa)
 	c->mon->sel = c;
 
 	if (riopid && (!riodraw_matchpid || isdescprocess(riopid, c->pid))) {
-		if (riodimensions[3] != -1)
+		if (rioselecting) {
+			/* positioned by riodrawdone() once the area is drawn */
+			riowin = c->win;
+			riopid = 0;
+		} else if (riodimensions[3] != -1)
 			rioposition(c, riodimensions[0], riodimensions[1], riodimensions[2], riodimensions[3]);
 		else {
 			killclient(&((Arg) { .v = c }));
@@ -3300,9 +3827,10 @@ manage(Window w, XWindowAttributes *wa)
 		}
 	}
 	arrange(c->mon);
-	if (!HIDDEN(c))
+	if (!HIDDEN(c) && !(sc && sc[SessSwallowed]))
 		XMapWindow(dpy, c->win);
 	focus(NULL);
+	spawnlatency(c);
 }
 
 void
@@ -3345,7 +3873,7 @@ maprequest(XEvent *e)
 		break;
 	default:
 		/* No client is managing the window. See if any swallows match. */
-		if ((s = swalmatch(ev->window)))
+		if ((s = swalmatch(ev->window, NULL)))
 			swalmanage(s, ev->window, &wa);
 		else
 			manage(ev->window, &wa);
@@ -3360,6 +3888,7 @@ maprequest(XEvent *e)
 void
 monocle(Monitor *m)
 {
+	TRACE_SCOPE("monocle");
 	unsigned int n = 0;
 	Client *c;
 
@@ -3881,6 +4410,16 @@ nexttiled(Client *c)
 	return c;
 }
 
+/* Monotonic clock in nanoseconds, used for latency statistics */
+uint64_t
+nsnow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 void
 opacity(Client *c, double opacity)
 {
@@ -3924,7 +4463,6 @@ propertynotify(XEvent *e)
 {
 	Client *c;
 	Window trans;
-	Swallow *s;
 	XPropertyEvent *ev = &e->xproperty;
 
 	if ((c = wintosystrayicon(ev->window))) {
@@ -3962,12 +4500,11 @@ propertynotify(XEvent *e)
 			break;
 		}
 		if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) {
-			updatetitle(c);
-			if (c == c->mon->sel)
-				drawbar(c->mon);
-			drawtab(c->mon);
-			if (swalretroactive && (s = swalmatch(c->win))) {
-				swal(s->client, c, 0);
+			/* read once the batch of events is handled, see updatetitles() */
+			if (!c->titlepending) {
+				c->titlepending = 1;
+				c->titlenext = titlequeue;
+				titlequeue = c;
 			}
 		}
 		else if (ev->atom == netatom[NetWMIcon]) {
@@ -3977,11 +4514,70 @@ propertynotify(XEvent *e)
 		}
 		if (ev->atom == netatom[NetWMWindowType])
 			updatewindowtype(c);
+		if (ev->atom == XA_WM_CLASS && c->win == swalcand.win)
+			swalcand.win = None;
 		if (ev->atom == motifatom)
 			updatemotifhints(c);
 	}
 }
 
+/* Sends the property requests manage() needs for w without waiting for the
+ * replies, so that mapping a window costs about one round trip instead of
+ * one per property. getprop() and winpid() take the pending replies. */
+void
+propprefetch(PropPrefetch *pf, Window w)
+{
+	struct { Atom prop, type; uint32_t len; } req[PropLast] = {
+		[PropNetWMName]       = { netatom[NetWMName], AnyPropertyType, TEXTPROPLEN },
+		[PropWMName]          = { XA_WM_NAME, AnyPropertyType, TEXTPROPLEN },
+		[PropTransient]       = { XA_WM_TRANSIENT_FOR, XA_WINDOW, 1 },
+		[PropClass]           = { XA_WM_CLASS, XA_STRING, TEXTPROPLEN },
+		[PropRole]            = { wmatom[WMWindowRole], AnyPropertyType, TEXTPROPLEN },
+		[PropNetWMState]      = { netatom[NetWMState], XA_ATOM, 2 },
+		[PropNetWMWindowType] = { netatom[NetWMWindowType], XA_ATOM, 2 },
+		[PropNormalHints]     = { XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS, 18 },
+		[PropWMHints]         = { XA_WM_HINTS, XA_WM_HINTS, 9 },
+		[PropMotif]           = { motifatom, motifatom, 5 },
+		[PropIcon]            = { netatom[NetWMIcon], AnyPropertyType, UINT32_MAX },
+	};
+	int i;
+
+	pf->win = w;
+	for (i = 0; i < PropLast; i++) {
+		pf->prop[i] = req[i].prop;
+		pf->type[i] = req[i].type;
+		pf->len[i] = req[i].len;
+		if ((pf->pending[i] = i != PropMotif || decorhints))
+			pf->cookie[i] = xcb_get_property(xcon, 0, w, req[i].prop, req[i].type, 0, req[i].len);
+	}
+#ifdef __linux__
+	xcb_res_client_id_spec_t spec = { .client = w, .mask = XCB_RES_CLIENT_ID_MASK_LOCAL_CLIENT_PID };
+	pf->pid = xcb_res_query_client_ids(xcon, 1, &spec);
+	pf->pidpending = 1;
+	xcbseq = pf->pid.sequence;
+#else
+	xcbseq = pf->cookie[PropIcon].sequence;
+#endif /* __linux__ */
+	prefetch = pf;
+}
+
+/* Drops the replies nobody asked for */
+void
+propprefetchend(PropPrefetch *pf)
+{
+	int i;
+
+	for (i = 0; i < PropLast; i++)
+		if (pf->pending[i])
+			xcb_discard_reply(xcon, pf->cookie[i].sequence);
+#ifdef __linux__
+	if (pf->pidpending)
+		xcb_discard_reply(xcon, pf->pid.sequence);
+#endif /* __linux__ */
+	if (prefetch == pf)
+		prefetch = NULL;
+}
+
 void
 pushdown(const Arg *arg) {
 	Client *sel = selmon->sel, *c;
@@ -4059,6 +4655,74 @@ recttomon(int x, int y, int w, int h)
 	return r;
 }
 
+/* Redraws the damaged bars and tabs, run by redrawtimer */
+void
+redraw(void *arg)
+{
+	Monitor *m;
+	int damage;
+
+	lastredraw = nsnow();
+	for (m = mons; m; m = m->next) {
+		damage = m->damage;
+		m->damage = 0;
+		if (damage & DamageBar)
+			drawbarnow(m);
+		if (damage & DamageTab)
+			drawtabnow(m);
+	}
+}
+
+/* Runs redraw() once the current batch of events is handled, or at the start
+ * of the next frame if the last redraw was less than a frame ago. */
+void
+redrawschedule(void)
+{
+	uint64_t now, next;
+
+	if (redrawtimer.armed)
+		return;
+	now = nsnow();
+	next = lastredraw + frameinterval;
+	timerset(&redrawtimer, next > now ? next - now : 0, 0, redraw, NULL);
+}
+
+/* Returns the ns between redraws, one frame of the display unless
+ * redrawinterval is set */
+uint64_t
+refreshinterval(void)
+{
+	int rate = 60;
+#ifdef XRANDR
+	XRRScreenConfiguration *conf;
+#endif /* XRANDR */
+
+	if (redrawinterval)
+		return redrawinterval * 1000ULL;
+#ifdef XRANDR
+	if ((conf = XRRGetScreenInfo(dpy, root))) {
+		if (XRRConfigCurrentRate(conf) > 0)
+			rate = XRRConfigCurrentRate(conf);
+		XRRFreeScreenConfigInfo(conf);
+	}
+#endif /* XRANDR */
+	return 1000000000ULL / rate;
+}
+
+void
+releaseupdates(void)
+{
+	Monitor *m;
+
+	if (!updateshold || --updateshold)
+		return;
+	for (m = mons; m; m = m->next)
+		if (m->arrangepending) {
+			m->arrangepending = 0;
+			arrange(m);
+		}
+}
+
 void
 removesystrayicon(Client *i)
 {
@@ -4069,7 +4733,7 @@ removesystrayicon(Client *i)
 	for (ii = &systray->icons; *ii && *ii != i; ii = &(*ii)->next);
 	if (ii)
 		*ii = i->next;
-	free(i);
+	clientfree(i);
 }
 
 
@@ -4252,11 +4916,14 @@ restack(Monitor *m)
 	Client *c;
 	XEvent ev;
 	XWindowChanges wc;
+	uint64_t start = nsnow();
 
 	drawbar(m);
 	drawtab(m);
-	if (!m->sel)
+	if (!m->sel) {
+		histadd(&restackstats, start);
 		return;
+	}
 	if (m->sel->isfloating || !m->lt[m->sellt]->arrange)
 		XRaiseWindow(dpy, m->sel->win);
 
@@ -4281,57 +4948,78 @@ restack(Monitor *m)
 	}
 	XSync(dpy, False);
 	while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
+	histadd(&restackstats, start);
 }
 
-int
+/* Starts slop to drag out an area. Once it is drawn riodrawdone() resizes c
+ * to it, or with c NULL positions the window spawned by riospawn(). */
+void
 riodraw(Client *c, const char slopstyle[])
+{
+	char slopcmd[100] = "slop -f x%xx%yx%wx%hx ";
+
+	if (rioselecting)
+		return;
+	strcat(slopcmd, slopstyle);
+	if (subprocrun(slopcmd, 1, riodrawdone, c ? (void *)(uintptr_t)c->win : NULL) == 0)
+		rioselecting = 1;
+}
+
+void
+riodrawdone(char *out, void *arg)
 {
 	int i;
-	char str[100] = {0};
 	char strout[100] = {0};
 	char tmpstring[30] = {0};
-	char slopcmd[100] = "slop -f x%xx%yx%wx%hx ";
 	int firstchar = 0;
 	int counter = 0;
+	int valid = 0;
+	Window w = (Window)(uintptr_t)arg;
+	Client *c;
 
-	strcat(slopcmd, slopstyle);
-	FILE *fp = popen(slopcmd, "r");
-
-	while (fgets(str, 100, fp) != NULL)
-		strcat(strout, str);
-
-	pclose(fp);
-
-	if (strlen(strout) < 6)
-		return 0;
+	rioselecting = 0;
+	if (out)
+		strncpy(strout, out, sizeof(strout) - 1);
 
-	for (i = 0; i < strlen(strout); i++){
-		if (!firstchar) {
-			if (strout[i] == 'x')
-				firstchar = 1;
-			continue;
-		}
+	if (strlen(strout) >= 6) {
+		for (i = 0; i < strlen(strout) && counter < 4; i++){
+			if (!firstchar) {
+				if (strout[i] == 'x')
+					firstchar = 1;
+				continue;
+			}
 
-		if (strout[i] != 'x')
-			tmpstring[strlen(tmpstring)] = strout[i];
-		else {
-			riodimensions[counter] = atoi(tmpstring);
-			counter++;
-			memset(tmpstring,0,strlen(tmpstring));
+			if (strout[i] != 'x') {
+				if (strlen(tmpstring) < sizeof(tmpstring) - 1)
+					tmpstring[strlen(tmpstring)] = strout[i];
+			} else {
+				riodimensions[counter] = atoi(tmpstring);
+				counter++;
+				memset(tmpstring,0,sizeof(tmpstring));
+			}
 		}
+		valid = !(riodimensions[0] <= -40 || riodimensions[1] <= -40 || riodimensions[2] <= 50 || riodimensions[3] <= 50);
 	}
-
-	if (riodimensions[0] <= -40 || riodimensions[1] <= -40 || riodimensions[2] <= 50 || riodimensions[3] <= 50) {
+	if (!valid)
 		riodimensions[3] = -1;
-		return 0;
-	}
 
-	if (c) {
-		rioposition(c, riodimensions[0], riodimensions[1], riodimensions[2], riodimensions[3]);
-		return 0;
+	if (w) {
+		/* rioresize(), the client may be gone by now */
+		if (valid && (c = wintoclient(w)))
+			rioposition(c, riodimensions[0], riodimensions[1], riodimensions[2], riodimensions[3]);
+	} else if (!riodraw_spawnasync) {
+		if (valid)
+			riopid = spawncmd(&riospawnarg);
+	} else if (riowin) {
+		/* the spawned window was mapped while drawing */
+		if ((c = wintoclient(riowin))) {
+			if (valid)
+				rioposition(c, riodimensions[0], riodimensions[1], riodimensions[2], riodimensions[3]);
+			else
+				killclient(&((Arg) { .v = c }));
+		}
+		riowin = None;
 	}
-
-	return 1;
 }
 
 void
@@ -4374,11 +5062,13 @@ rioresize(const Arg *arg)
 void
 riospawn(const Arg *arg)
 {
-	if (riodraw_spawnasync) {
-		riopid = spawncmd(arg);
-		riodraw(NULL, slopspawnstyle);
-	} else if (riodraw(NULL, slopspawnstyle))
+	if (rioselecting)
+		return;
+	if (riodraw_spawnasync)
 		riopid = spawncmd(arg);
+	else
+		riospawnarg = *arg; /* spawned by riodrawdone() */
+	riodraw(NULL, slopspawnstyle);
 }
 
 void
@@ -4387,6 +5077,7 @@ run(void)
 	int event_count = 0;
 	const int MAX_EVENTS = 10;
 	struct epoll_event events[MAX_EVENTS];
+	Subproc *sp;
 
 	XSync(dpy, False);
 
@@ -4404,6 +5095,14 @@ run(void)
 					return;
 			} else if (event_fd == ipc_get_sock_fd()) {
 				ipc_handle_socket_epoll_event(events + i);
+			} else if (event_fd == signal_fd) {
+				handlesignals();
+			} else if (event_fd == timer_fd) {
+				timerhandle();
+			} else if (event_fd == proc_fd) {
+				prochandle();
+			} else if ((sp = subprocfind(event_fd))) {
+				subprochandle(sp);
 			} else if (ipc_is_client_registered(event_fd)){
 				if (ipc_handle_client_epoll_event(events + i, mons, &lastselmon, selmon,
 							tags, LENGTH(tags), layouts, LENGTH(layouts)) < 0) {
@@ -4417,6 +5116,14 @@ run(void)
 				return;
 			}
 		}
+		/* the redraw timer, IPC commands and helper callbacks may XSync(),
+		 * which moves pending X events to the Xlib queue without leaving
+		 * dpy_fd readable */
+		if (running && QLength(dpy)) {
+			struct epoll_event xev = { .events = EPOLLIN, .data.fd = dpy_fd };
+
+			handlexevent(&xev);
+		}
 	}
 }
 
@@ -4424,11 +5131,12 @@ void
 runautostart(void)
 {
 	char *pathpfx;
-	char *path;
+	char *path, *next;
 	char *xdgdatahome;
 	char *home;
 	struct stat sb;
 
+	autostartstart = nsnow();
 	if ((home = getenv("HOME")) == NULL)
 		/* this is almost impossible */
 		return;
@@ -4474,54 +5182,349 @@ runautostart(void)
 		}
 	}
 
-	/* try the blocking script first */
+	/* try the blocking script first, the non-blocking script is started
+	 * once it is done, see runautostartdone() */
 	path = ecalloc(1, strlen(pathpfx) + strlen(autostartblocksh) + 2);
 	if (sprintf(path, "%s/%s", pathpfx, autostartblocksh) <= 0) {
 		free(path);
 		free(pathpfx);
+		return;
 	}
-
-	if (access(path, X_OK) == 0)
-		system(path);
-
-	/* now the non-blocking script */
-	if (sprintf(path, "%s/%s", pathpfx, autostartsh) <= 0) {
+	next = ecalloc(1, strlen(pathpfx) + strlen(autostartsh) + 2);
+	if (sprintf(next, "%s/%s", pathpfx, autostartsh) <= 0) {
+		free(next);
 		free(path);
 		free(pathpfx);
+		return;
 	}
 
-	if (access(path, X_OK) == 0)
-		system(strcat(path, " &"));
+	if (access(path, X_OK) != 0 || subprocrun(path, 0, runautostartdone, next) != 0)
+		runautostartdone(NULL, next);
 
 	free(pathpfx);
 	free(path);
 }
 
+/* Starts the non-blocking autostart script at path arg */
+void
+runautostartdone(char *out, void *arg)
+{
+	char *path = arg;
+
+	fprintf(stderr, "dwm: startup: autostart %.1f ms\n", (nsnow() - autostartstart) / 1e6);
+	if (access(path, X_OK) == 0)
+		subprocrun(path, 0, NULL, NULL);
+	free(path);
+}
+
 void
 scan(void)
 {
 	unsigned int i, num;
 	Window d1, d2, *wins = NULL;
-	XWindowAttributes wa;
-
+	xcb_get_window_attributes_reply_t *ar;
+	xcb_get_geometry_reply_t *gr;
+	xcb_get_property_reply_t *pr;
+	struct {
+		xcb_get_window_attributes_cookie_t attr;
+		xcb_get_geometry_cookie_t geom;
+		xcb_get_property_cookie_t trans, state;
+	} *ck;
+	struct {
+		XWindowAttributes wa;
+		int ok, transient, shown;
+	} *ws;
+
+	loadsession();
 	if (XQueryTree(dpy, root, &d1, &d2, &wins, &num)) {
+		/* query all children in one batch instead of a few round trips
+		 * per window, XGetWindowAttributes is attributes plus geometry */
+		ck = ecalloc(num, sizeof(*ck));
+		ws = ecalloc(num, sizeof(*ws));
 		for (i = 0; i < num; i++) {
-			if (!XGetWindowAttributes(dpy, wins[i], &wa)
-			|| wa.override_redirect || XGetTransientForHint(dpy, wins[i], &d1))
-				continue;
-			if (wa.map_state == IsViewable || getstate(wins[i]) == IconicState)
-				manage(wins[i], &wa);
+			ck[i].attr = xcb_get_window_attributes(xcon, wins[i]);
+			ck[i].geom = xcb_get_geometry(xcon, wins[i]);
+			ck[i].trans = xcb_get_property(xcon, 0, wins[i], XA_WM_TRANSIENT_FOR, XA_WINDOW, 0, 1);
+			ck[i].state = xcb_get_property(xcon, 0, wins[i], wmatom[WMState], wmatom[WMState], 0, 2);
+			xcbseq = ck[i].state.sequence;
 		}
-		for (i = 0; i < num; i++) { /* now the transients */
-			if (!XGetWindowAttributes(dpy, wins[i], &wa))
-				continue;
-			if (XGetTransientForHint(dpy, wins[i], &d1)
-			&& (wa.map_state == IsViewable || getstate(wins[i]) == IconicState))
-				manage(wins[i], &wa);
+		for (i = 0; i < num; i++) {
+			ar = xcbreply(ck[i].attr.sequence, NULL);
+			gr = xcbreply(ck[i].geom.sequence, NULL);
+			if ((ws[i].ok = ar && gr)) {
+				ws[i].wa.x = gr->x;
+				ws[i].wa.y = gr->y;
+				ws[i].wa.width = gr->width;
+				ws[i].wa.height = gr->height;
+				ws[i].wa.border_width = gr->border_width;
+				ws[i].wa.map_state = ar->map_state;
+				ws[i].wa.override_redirect = ar->override_redirect;
+				/* swallowed clients were unmapped by the old process */
+				ws[i].shown = ar->map_state == IsViewable || sessionclient(wins[i]);
+			}
+			if ((pr = xcbreply(ck[i].trans.sequence, NULL))) {
+				/* same test as gettransient() */
+				ws[i].transient = pr->type == XA_WINDOW && pr->format == 32
+					&& pr->value_len;
+				free(pr);
+			}
+			if ((pr = xcbreply(ck[i].state.sequence, NULL))) {
+				if (pr->format == 32 && pr->value_len
+				&& *(uint32_t *)xcb_get_property_value(pr) == IconicState)
+					ws[i].shown = 1;
+				free(pr);
+			}
+			free(ar);
+			free(gr);
 		}
+		for (i = 0; i < num; i++)
+			if (ws[i].ok && !ws[i].wa.override_redirect && !ws[i].transient && ws[i].shown)
+				manage(wins[i], &ws[i].wa);
+		for (i = 0; i < num; i++) /* now the transients */
+			if (ws[i].ok && ws[i].transient && ws[i].shown)
+				manage(wins[i], &ws[i].wa);
+		free(ck);
+		free(ws);
 		if (wins)
 			XFree(wins);
 	}
+	restoresession();
+}
+
+/* Reads and removes the state stored by savesession() before the restart.
+ * It is only used if it matches this build's tags. */
+void
+loadsession(void)
+{
+	Atom prop = XInternAtom(dpy, "_DWM_SESSION", False);
+	uint32_t *v;
+
+	if (!(session = getprop(root, prop, XA_CARDINAL, UINT32_MAX)))
+		return;
+	XDeleteProperty(dpy, root, prop);
+	v = xcb_get_property_value(session);
+	if (session->format != 32 || session->value_len < SessHeaderLast
+	|| v[SessVersion] != SESSIONVERSION || v[SessNumTags] != LENGTH(tags)
+	/* left behind by a restart which failed to exec */
+	|| v[SessPid] != (uint32_t)getpid()
+	|| session->value_len != SessHeaderLast + v[SessMons] * SESSMONLEN + v[SessClients] * SessClientLast) {
+		free(session);
+		session = NULL;
+	}
+}
+
+/* Applies the restored monitor and client state once scan() has managed all
+ * windows, and drops it */
+void
+restoresession(void)
+{
+	uint32_t *v, *r, *cr;
+	unsigned int i, j, nmons, n;
+	Monitor *m;
+	Client **cs, **st, *c;
+
+	if (!session)
+		return;
+	v = xcb_get_property_value(session);
+	nmons = v[SessMons];
+	n = v[SessClients];
+	r = v + SessHeaderLast;
+	for (i = 0; i < nmons; i++, r += SESSMONLEN) {
+		for (m = mons; m && m->num != (int)r[SessMonNum]; m = m->next);
+		if (!m)
+			continue;
+		m->seltags = r[SessMonSeltags] & 1;
+		m->sellt = r[SessMonSellt] & 1;
+		m->tagset[0] = r[SessMonTagset0];
+		m->tagset[1] = r[SessMonTagset1];
+		m->nmaster = r[SessMonNmaster];
+		m->mfact = sessionunfloat(r[SessMonMfact]);
+		m->showbar = r[SessMonShowbar];
+		m->lt[0] = &layouts[MIN(r[SessMonLt0], LENGTH(layouts) - 1)];
+		m->lt[1] = &layouts[MIN(r[SessMonLt1], LENGTH(layouts) - 1)];
+		m->pertag->curtag = MIN(r[SessMonCurtag], LENGTH(tags));
+		m->pertag->prevtag = MIN(r[SessMonPrevtag], LENGTH(tags));
+		for (j = 0; j <= LENGTH(tags); j++) {
+			uint32_t *t = r + SessMonLast + j * SessTagLast;
+
+			m->pertag->nmasters[j] = t[SessTagNmaster];
+			m->pertag->mfacts[j] = sessionunfloat(t[SessTagMfact]);
+			m->pertag->sellts[j] = t[SessTagSellt] & 1;
+			m->pertag->ltidxs[j][0] = &layouts[MIN(t[SessTagLt0], LENGTH(layouts) - 1)];
+			m->pertag->ltidxs[j][1] = &layouts[MIN(t[SessTagLt1], LENGTH(layouts) - 1)];
+			m->pertag->showbars[j] = t[SessTagShowbar];
+		}
+		updatebarpos(m);
+		resizebarwin(m);
+		strncpy(m->ltsymbol, m->lt[m->sellt]->symbol, sizeof m->ltsymbol);
+	}
+
+	/* restore list order by moving the clients to the head in reverse,
+	 * windows not known to the old process stay behind them */
+	cs = ecalloc(n, sizeof(Client *));
+	st = ecalloc(n, sizeof(Client *));
+	for (i = 0, cr = r; i < n; i++, cr += SessClientLast)
+		if ((cs[i] = wintoclient(cr[SessWin])) && cr[SessStackpos] < n)
+			st[cr[SessStackpos]] = cs[i];
+	for (i = n; i-- > 0;) {
+		cr = r + i * SessClientLast;
+		if (!(c = cs[i]))
+			continue;
+		c->sfx = (int32_t)cr[SessSfx];
+		c->sfy = (int32_t)cr[SessSfy];
+		c->sfw = (int32_t)cr[SessSfw];
+		c->sfh = (int32_t)cr[SessSfh];
+		c->cfact = sessionunfloat(cr[SessCfact]);
+		detach(c);
+		detachstack(c);
+		if (!cr[SessSwallowed])
+			attach(c);
+	}
+	for (i = n; i-- > 0;)
+		if (st[i])
+			attachstack(st[i]);
+	for (i = 0; i < n; i++) {
+		cr = r + i * SessClientLast;
+		if (!(c = cs[i]) || !cr[SessSwallowedby])
+			continue;
+		for (j = 0; j < n && !(cs[j] && cs[j]->win == cr[SessSwallowedby]); j++);
+		if (j < n)
+			c->swallowedby = cs[j];
+	}
+	for (i = 0; i < n; i++)
+		if (cs[i] && r[i * SessClientLast + SessSwallowed]) {
+			setclientstate(cs[i], WithdrawnState);
+			XUnmapWindow(dpy, cs[i]->win);
+		}
+	for (m = mons; m && m->num != (int)v[SessSelmon]; m = m->next);
+	if (m)
+		selmon = m;
+	free(cs);
+	free(st);
+	free(session);
+	session = NULL;
+	focus(NULL);
+	arrange(NULL);
+}
+
+/* Stores the state a restart would otherwise lose in the _DWM_SESSION root
+ * window property, for the new process to pick up in scan() instead of
+ * evaluating rules again: monitor and per-tag layout settings, and for every
+ * client its monitor, tags, geometry, cfact, scratchpad key, position in the
+ * client list and focus stack and its swallow chain. */
+void
+savesession(void)
+{
+	Monitor *m;
+	Client *c, *s, *t;
+	long *v, *r;
+	unsigned int i, n = 0, nmons = 0;
+	size_t len;
+
+	for (m = mons; m; m = m->next, nmons++)
+		for (c = m->clients; c; c = c->next)
+			for (s = c; s; s = s->swallowedby)
+				n++;
+	len = SessHeaderLast + nmons * SESSMONLEN + n * SessClientLast;
+	v = ecalloc(len, sizeof(long));
+	v[SessVersion] = SESSIONVERSION;
+	v[SessPid] = getpid(); /* kept by execvp() */
+	v[SessNumTags] = LENGTH(tags);
+	v[SessMons] = nmons;
+	v[SessClients] = n;
+	v[SessSelmon] = selmon->num;
+	r = v + SessHeaderLast;
+	for (m = mons; m; m = m->next, r += SESSMONLEN) {
+		r[SessMonNum] = m->num;
+		r[SessMonSeltags] = m->seltags;
+		r[SessMonSellt] = m->sellt;
+		r[SessMonTagset0] = m->tagset[0];
+		r[SessMonTagset1] = m->tagset[1];
+		r[SessMonNmaster] = m->nmaster;
+		r[SessMonMfact] = sessionfloat(m->mfact);
+		r[SessMonShowbar] = m->showbar;
+		r[SessMonLt0] = m->lt[0] - layouts;
+		r[SessMonLt1] = m->lt[1] - layouts;
+		r[SessMonCurtag] = m->pertag->curtag;
+		r[SessMonPrevtag] = m->pertag->prevtag;
+		for (i = 0; i <= LENGTH(tags); i++) {
+			long *tr = r + SessMonLast + i * SessTagLast;
+
+			tr[SessTagNmaster] = m->pertag->nmasters[i];
+			tr[SessTagMfact] = sessionfloat(m->pertag->mfacts[i]);
+			tr[SessTagSellt] = m->pertag->sellts[i];
+			tr[SessTagLt0] = m->pertag->ltidxs[i][0] - layouts;
+			tr[SessTagLt1] = m->pertag->ltidxs[i][1] - layouts;
+			tr[SessTagShowbar] = m->pertag->showbars[i];
+		}
+	}
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			for (s = c; s; s = s->swallowedby, r += SessClientLast) {
+				for (i = 0, t = m->stack; t && t != s; t = t->snext, i++);
+				r[SessWin] = s->win;
+				r[SessMon] = m->num;
+				r[SessClientTags] = c->tags;
+				r[SessFloating] = s->isfloating;
+				r[SessX] = s->x;
+				r[SessY] = s->y;
+				r[SessW] = s->w;
+				r[SessH] = s->h;
+				r[SessSfx] = s->sfx;
+				r[SessSfy] = s->sfy;
+				r[SessSfw] = s->sfw;
+				r[SessSfh] = s->sfh;
+				r[SessCfact] = sessionfloat(s->cfact);
+				r[SessScratchkey] = s->scratchkey;
+				r[SessSticky] = s->issticky;
+				r[SessAlwaysontop] = s->isalwaysontop;
+				r[SessCanfocus] = s->canfocus;
+				r[SessFloatbw] = s->floatborderpx;
+				r[SessHasfloatbw] = s->hasfloatbw;
+				r[SessStackpos] = t ? i : n;
+				r[SessSwallowedby] = s->swallowedby ? s->swallowedby->win : None;
+				r[SessSwallowed] = s != c;
+				r[SessSwitchtag] = s->switchtag;
+			}
+	XChangeProperty(dpy, root, XInternAtom(dpy, "_DWM_SESSION", False), XA_CARDINAL, 32,
+		PropModeReplace, (unsigned char *)v, len);
+	XSync(dpy, False);
+	free(v);
+}
+
+long
+sessionfloat(float f)
+{
+	uint32_t v;
+
+	memcpy(&v, &f, sizeof v);
+	return v;
+}
+
+/* Returns the saved record of window w, NULL if there is none */
+const uint32_t *
+sessionclient(Window w)
+{
+	uint32_t *v, *r;
+	unsigned int i;
+
+	if (!session)
+		return NULL;
+	v = xcb_get_property_value(session);
+	r = v + SessHeaderLast + v[SessMons] * SESSMONLEN;
+	for (i = 0; i < v[SessClients]; i++, r += SessClientLast)
+		if (r[SessWin] == w)
+			return r;
+	return NULL;
+}
+
+float
+sessionunfloat(uint32_t v)
+{
+	float f;
+
+	memcpy(&f, &v, sizeof f);
+	return f;
 }
 
 static void scratchpad_hide ()
@@ -4841,11 +5844,23 @@ setup(void)
 	XSetWindowAttributes wa;
 	Atom utf8string;
 
+	/* signals are read from signal_fd in run() instead of interrupting
+	 * it, see handlesignals(). They stay blocked across a restart. */
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGCHLD);
+	sigaddset(&sigmask, SIGHUP);
+	sigaddset(&sigmask, SIGTERM);
+	sigaddset(&sigmask, SIGUSR1);
+	sigaddset(&sigmask, SIGUSR2);
+	if (sigprocmask(SIG_BLOCK, &sigmask, NULL) < 0
+	|| (signal_fd = signalfd(-1, &sigmask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+		die("can't set up signalfd:");
+
 	/* clean up any zombies immediately */
-	sigchld(0);
+	while (0 < waitpid(-1, NULL, WNOHANG));
 
-	signal(SIGHUP, sighup);
-	signal(SIGTERM, sigterm);
+	/* count round trips to the X server, see xafter() */
+	XSetAfterFunction(dpy, xafter);
 
 	/* init screen */
 	screen = DefaultScreen(dpy);
@@ -4859,6 +5874,11 @@ setup(void)
 	lrpad = drw->fonts->h + horizpadbar;
 	bh = user_bh ? user_bh : drw->fonts->h + horizpadbar;
 	th = bh;
+#ifdef XRANDR
+	if (XRRQueryExtension(dpy, &rrevbase, &i))
+		XRRSelectInput(dpy, root, RRScreenChangeNotifyMask);
+#endif /* XRANDR */
+	frameinterval = refreshinterval();
 	updategeom();
 	sp = sidepad;
 	vp = (topbar == 1) ? vertpad : - vertpad;
@@ -4940,8 +5960,10 @@ setup(void)
 void
 setupepoll(void)
 {
-	epoll_fd = epoll_create1(0);
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
 	dpy_fd = ConnectionNumber(dpy);
+	/* spawned programs must not inherit the X connection */
+	fcntl(dpy_fd, F_SETFD, FD_CLOEXEC);
 	struct epoll_event dpy_event;
 
 	// Initialize struct to 0
@@ -4964,6 +5986,33 @@ setupepoll(void)
 	if (ipc_init(ipcsockpath, epoll_fd, ipccommands, LENGTH(ipccommands)) < 0) {
 		fputs("Failed to initialize IPC\n", stderr);
 	}
+
+	struct epoll_event signal_event = { .events = EPOLLIN, .data.fd = signal_fd };
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &signal_event)) {
+		fputs("Failed to add signal file descriptor to epoll", stderr);
+		close(epoll_fd);
+		exit(1);
+	}
+
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	struct epoll_event timer_event = { .events = EPOLLIN, .data.fd = timer_fd };
+	if (timer_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &timer_event)) {
+		fputs("Failed to add timer file descriptor to epoll", stderr);
+		close(epoll_fd);
+		exit(1);
+	}
+	/* timers set during setup, like the first bar redraw */
+	timerarm();
+
+	/* without the process connector parent pids are read from /proc */
+	if ((proc_fd = procopen()) >= 0) {
+		struct epoll_event proc_event = { .events = EPOLLIN, .data.fd = proc_fd };
+
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, proc_fd, &proc_event)) {
+			procclose();
+			proc_fd = -1;
+		}
+	}
 }
 
 void
@@ -5033,27 +6082,23 @@ showtagpreview(int tag)
 		XUnmapWindow(dpy, selmon->tagwin);
 }
 
-void
-sigchld(int unused)
-{
-	if (signal(SIGCHLD, sigchld) == SIG_ERR)
-		die("can't install SIGCHLD handler:");
-	while (0 < waitpid(-1, NULL, WNOHANG));
-}
-
-void
-sighup(int unused)
+#if defined(SYS_pidfd_open) && defined(SYS_pidfd_send_signal)
+/* sigqueue() through a pidfd, which cannot hit another process reusing the
+ * pid */
+int
+pidfdqueue(int fd, int sig, union sigval sv)
 {
-	Arg a = {.i = 1};
-	quit(&a);
-}
+	siginfo_t si;
 
-void
-sigterm(int unused)
-{
-	Arg a = {.i = 0};
-	quit(&a);
+	memset(&si, 0, sizeof(si));
+	si.si_signo = sig;
+	si.si_code = SI_QUEUE;
+	si.si_pid = getpid();
+	si.si_uid = getuid();
+	si.si_value = sv;
+	return syscall(SYS_pidfd_send_signal, fd, sig, &si, 0);
 }
+#endif
 
 void
 sigstatusbar(const Arg *arg)
@@ -5063,8 +6108,26 @@ sigstatusbar(const Arg *arg)
 	if (!statussig)
 		return;
 	sv.sival_int = arg->i;
+#if defined(SYS_pidfd_open) && defined(SYS_pidfd_send_signal)
+	/* as long as the status bar runs its pidfd stays valid and nothing
+	 * needs to be looked up */
+	if (statuspidfd >= 0) {
+		if (!pidfdqueue(statuspidfd, SIGRTMIN+statussig, sv))
+			return;
+		close(statuspidfd);
+		statuspidfd = -1;
+	}
+#endif
 	if ((statuspid = getstatusbarpid()) <= 0)
 		return;
+#if defined(SYS_pidfd_open) && defined(SYS_pidfd_send_signal)
+	if ((statuspidfd = syscall(SYS_pidfd_open, statuspid, 0)) >= 0) {
+		if (!pidfdqueue(statuspidfd, SIGRTMIN+statussig, sv))
+			return;
+		close(statuspidfd);
+		statuspidfd = -1;
+	}
+#endif
 
 	sigqueue(statuspid, SIGRTMIN+statussig, sv);
 }
@@ -5078,24 +6141,107 @@ spawn(const Arg *arg)
 pid_t
 spawncmd(const Arg *arg)
 {
-	pid_t pid;
 	if (arg->v == dmenucmd)
 		dmenumon[0] = '0' + selmon->num;
-	if ((pid = fork()) == 0) {
-		if (dpy)
-			close(ConnectionNumber(dpy));
+	return spawnprog((char *const *)arg->v);
+}
+
+/* Records the time since the spawn of the command c belongs to, if c is its
+ * first window. Spawns without a window after SPAWNTIMEOUT are dropped. */
+void
+spawnlatency(Client *c)
+{
+	uint64_t now = nsnow();
+	unsigned int i;
+
+	if (!c->pid)
+		return;
+	for (i = 0; i < LENGTH(spawnpending); i++) {
+		if (!spawnpending[i].pid)
+			continue;
+		if (now - spawnpending[i].start > SPAWNTIMEOUT)
+			spawnpending[i].pid = 0;
+		else if (isdescprocess(spawnpending[i].pid, c->pid)) {
+			histadd(&spawnpending[i].stats->latency, spawnpending[i].start);
+			spawnpending[i].pid = 0;
+			return;
+		}
+	}
+}
+
+/* Forgets the spawn of pid once it exited, its pid may be reused */
+void
+spawnreaped(pid_t pid)
+{
+	unsigned int i;
+
+	for (i = 0; i < LENGTH(spawnpending); i++)
+		if (spawnpending[i].pid == pid)
+			spawnpending[i].pid = 0;
+}
+
+/* Starts argv[0] in a new session without copying dwm's address space, the
+ * X connection is closed on exec. Returns the pid or -1. */
+pid_t
+spawnprog(char *const argv[])
+{
+	static unsigned int next;
+	const char *name;
+	unsigned int i;
+	pid_t pid;
+	sigset_t empty;
+	int err;
+
+	sigemptyset(&empty);
+#ifdef POSIX_SPAWN_SETSID
+	extern char **environ;
+	posix_spawnattr_t attr;
+
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK);
+	posix_spawnattr_setsigmask(&attr, &empty);
+	err = posix_spawnp(&pid, argv[0], NULL, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+#else
+	/* the child only calls setsid and exec while dwm is suspended, it
+	 * shares the memory of dwm, so a failed exec is passed back in err */
+	volatile int execerr = 0;
+
+	if ((pid = vfork()) == 0) {
 		setsid();
-		execvp(((char **)arg->v)[0], (char **)arg->v);
-		fprintf(stderr, "dwm: execvp %s", ((char **)arg->v)[0]);
+		sigprocmask(SIG_SETMASK, &empty, NULL);
+		execvp(argv[0], argv);
+		execerr = errno;
+		_exit(127);
+	}
+	err = pid < 0 ? errno : execerr;
+#endif
+	if (err) {
+		errno = err;
+		fprintf(stderr, "dwm: execvp %s", argv[0]);
 		perror(" failed");
-		exit(EXIT_SUCCESS);
+		return -1;
+	}
+
+	name = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+	for (i = 0; i < spawnstatslen && strcmp(spawnstats[i].name, name); i++);
+	if (i == spawnstatslen) {
+		if (spawnstatslen == LENGTH(spawnstats))
+			return pid;
+		snprintf(spawnstats[spawnstatslen++].name, sizeof(spawnstats[i].name), "%s", name);
 	}
+	/* overwrite the oldest spawn still waiting for a window */
+	spawnpending[next].pid = pid;
+	spawnpending[next].start = nsnow();
+	spawnpending[next].stats = &spawnstats[i];
+	next = (next + 1) % LENGTH(spawnpending);
 	return pid;
 }
 
 void
 switchtag(void)
 {
+	TRACE_SCOPE("switchtag");
   	int i;
 	unsigned int occ = 0;
 	Client *c;
@@ -5183,6 +6329,7 @@ swal(Client *swer, Client *swee, int manage)
 
 	/* ICCCM 4.1.3.1 */
 	setclientstate(swer, WithdrawnState);
+	ipc_client_removed(swer);
 	if (manage)
 		setclientstate(swee, NormalState);
 
@@ -5198,6 +6345,109 @@ swal(Client *swer, Client *swee, int manage)
 	restack(swer->mon);
 }
 
+Subproc *
+subprocfind(int fd)
+{
+	Subproc *p;
+
+	for (p = subprocs; p && p->fd != fd; p = p->next);
+	return p;
+}
+
+/* Reads the output of p, or its exit with the pidfd, and calls its done
+ * callback once it is complete */
+void
+subprochandle(Subproc *p)
+{
+	Subproc **pp;
+	char buf[512];
+	ssize_t n;
+
+	if (p->capture) {
+		while ((n = read(p->fd, buf, sizeof(buf))) > 0) {
+			n = MIN(n, sizeof(p->out) - 1 - p->len);
+			memcpy(p->out + p->len, buf, n);
+			p->out[p->len += n] = '\0';
+		}
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+	}
+
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, p->fd, NULL);
+	close(p->fd);
+	for (pp = &subprocs; *pp != p; pp = &(*pp)->next);
+	*pp = p->next;
+	p->done(p->capture ? p->out : NULL, p->arg);
+	free(p);
+}
+
+/* Runs cmd with the shell without waiting for it. done is called from run()
+ * with its standard output if capture is set, else with NULL once it exited.
+ * Returns 0 if done will be called, 1 if cmd runs but its end cannot be
+ * waited for and -1 if it could not be started. */
+int
+subprocrun(const char *cmd, int capture, void (*done)(char *out, void *arg), void *arg)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	int fds[2] = { -1, -1 };
+	Subproc *p;
+	pid_t pid;
+
+	if (capture && pipe(fds) < 0)
+		return -1;
+	if (capture) {
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	}
+	if ((pid = fork()) < 0) {
+		if (capture) {
+			close(fds[0]);
+			close(fds[1]);
+		}
+		return -1;
+	}
+	if (pid == 0) {
+		if (dpy)
+			close(ConnectionNumber(dpy));
+		sigprocmask(SIG_UNBLOCK, &sigmask, NULL);
+		if (capture)
+			dup2(fds[1], STDOUT_FILENO);
+		execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+		fprintf(stderr, "dwm: execl sh -c %s", cmd);
+		perror(" failed");
+		exit(EXIT_SUCCESS);
+	}
+	if (!done)
+		return 1;
+
+	p = ecalloc(1, sizeof(Subproc));
+	p->capture = capture;
+	p->done = done;
+	p->arg = arg;
+	if (capture) {
+		close(fds[1]);
+		fcntl(fds[0], F_SETFL, O_NONBLOCK);
+		p->fd = fds[0];
+	}
+#ifdef SYS_pidfd_open
+	else
+		p->fd = syscall(SYS_pidfd_open, pid, 0);
+#else
+	else
+		p->fd = -1;
+#endif
+	ev.data.fd = p->fd;
+	if (p->fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, p->fd, &ev) < 0) {
+		if (p->fd >= 0)
+			close(p->fd);
+		free(p);
+		return 1;
+	}
+	p->next = subprocs;
+	subprocs = p;
+	return 0;
+}
+
 /*
  * Register a future swallow with swallower. 'c' 'class', 'inst' and 'title'
  * shall point null-terminated strings or be NULL, implying a wildcard. If an
@@ -5207,34 +6457,18 @@ swal(Client *swer, Client *swee, int manage)
  */
 void swalreg(Client *c, const char *class, const char *inst, const char *title)
 {
-	Swallow *s;
+	Swallow *s, **ps;
 
 	if (!c)
 		return;
 
-	for (s = swallows; s; s = s->next) {
-		if (s->client == c) {
-			if (class)
-				strncpy(s->class, class, sizeof(s->class) - 1);
-			else
-				s->class[0] = '\0';
-			if (inst)
-				strncpy(s->inst, inst, sizeof(s->inst) - 1);
-			else
-				s->inst[0] = '\0';
-			if (title)
-				strncpy(s->title, title, sizeof(s->title) - 1);
-			else
-				s->title[0] = '\0';
-			s->decay = swaldecay;
-
-			/* Only one swallow per client. May return after first hit. */
-			return;
-		}
-	}
+	/* Only one swallow per client, an existing one is registered anew. */
+	for (s = swallows; s && s->client != c; s = s->qnext);
+	if (s)
+		swalrm(s);
 
 	s = ecalloc(1, sizeof(Swallow));
-	s->decay = swaldecay;
+	s->expires = swalmaps + swaldecay;
 	s->client = c;
 	if (class)
 		strncpy(s->class, class, sizeof(s->class) - 1);
@@ -5243,25 +6477,41 @@ void swalreg(Client *c, const char *class, const char *inst, const char *title)
 	if (title)
 		strncpy(s->title, title, sizeof(s->title) - 1);
 
-	s->next = swallows;
-	swallows = s;
+	ps = s->class[0] ? swalbucket(s->class) : &swalwild;
+	s->next = *ps;
+	*ps = s;
+	/* all instances decay at the same rate, the newest expires last */
+	s->qprev = swallowslast;
+	if (swallowslast)
+		swallowslast->qnext = s;
+	else
+		swallows = s;
+	swallowslast = s;
+}
+
+/*
+ * Return the swalidx bucket for windows of class 'class'.
+ */
+Swallow **
+swalbucket(const char *class)
+{
+	unsigned int h = 5381;
+
+	while (*class)
+		h = h * 33 + (unsigned char)*class++;
+	return &swalidx[h % LENGTH(swalidx)];
 }
 
 /*
- * Decrease decay counter of all registered swallows by 'decayby' and remove any
- * swallow instances whose counter is less than or equal to zero.
+ * Count 'decayby' mapped windows and remove any swallow instances which have
+ * expired. Only the oldest instances need to be looked at.
  */
 void
 swaldecayby(int decayby)
 {
-	Swallow *s, *t;
-
-	for (s = swallows; s; s = t) {
-		s->decay -= decayby;
-		t = s->next;
-		if (s->decay <= 0)
-			swalrm(s);
-	}
+	swalmaps += decayby;
+	while (swallows && swallows->expires <= swalmaps)
+		swalrm(swallows);
 }
 
 /*
@@ -5281,7 +6531,7 @@ swalmanage(Swallow *s, Window w, XWindowAttributes *wa)
 	 * may be used to perform the swallow. The following lines are basically a
 	 * minimal implementation of manage() with a few chunks delegated to
 	 * swal(). */
-	swee = ecalloc(1, sizeof(Client));
+	swee = clientalloc();
 	swee->win = w;
 	swee->mon = swer->mon;
 	swee->oldbw = wa->border_width;
@@ -5302,32 +6552,47 @@ swalmanage(Swallow *s, Window w, XWindowAttributes *wa)
 
 /*
  * Return swallow instance which targets window 'w' as determined by its class
- * name, instance name and window title. Returns NULL if none is found. Pendant
+ * name, instance name and window title. 'title' may be NULL if not known yet,
+ * otherwise WM_CLASS of 'w' is only read once for consecutive calls, as for
+ * title updates of the same client. Returns NULL if none is found. Pendant
  * to wintoclient().
  */
 Swallow *
-swalmatch(Window w)
+swalmatch(Window w, const char *title)
 {
-	XClassHint ch = { NULL, NULL };
 	Swallow *s = NULL;
-	char title[sizeof(s->title)];
-
-	XGetClassHint(dpy, w, &ch);
-	if (!gettextprop(w, netatom[NetWMName], title, sizeof(title)))
-		gettextprop(w, XA_WM_NAME, title, sizeof(title));
+	char buf[sizeof(s->title)];
+	int i;
 
-	for (s = swallows; s; s = s->next) {
-		if ((!ch.res_class || strstr(ch.res_class, s->class))
-			&& (!ch.res_name || strstr(ch.res_name, s->inst))
-			&& (title[0] == '\0' || strstr(title, s->title)))
-			break;
+	if (!swallows)
+		return NULL;
+	if (!title || w != swalcand.win) {
+		getclasshint(w, swalcand.class, swalcand.inst, sizeof(swalcand.class));
+		swalcand.win = w;
+	}
+	if (!title) {
+		if (!gettextprop(w, netatom[NetWMName], buf, sizeof(buf)))
+			gettextprop(w, XA_WM_NAME, buf, sizeof(buf));
+		title = buf;
+	}
+
+	/* Windows without class match any class filter. */
+	if (!swalcand.class[0]) {
+		for (s = swallows; s; s = s->qnext)
+			if ((!swalcand.inst[0] || !s->inst[0] || !strcmp(swalcand.inst, s->inst))
+				&& (title[0] == '\0' || strstr(title, s->title)))
+				return s;
+		return NULL;
 	}
-
-	if (ch.res_class)
-		XFree(ch.res_class);
-	if (ch.res_name)
-		XFree(ch.res_name);
-	return s;
+	for (i = 0; i < 2; i++) {
+		for (s = i ? swalwild : *swalbucket(swalcand.class); s; s = s->next) {
+			if ((i || !strcmp(swalcand.class, s->class))
+				&& (!swalcand.inst[0] || !s->inst[0] || !strcmp(swalcand.inst, s->inst))
+				&& (title[0] == '\0' || strstr(title, s->title)))
+				return s;
+		}
+	}
+	return NULL;
 }
 
 /*
@@ -5374,20 +6639,24 @@ swalmouse(const Arg *arg)
 void
 swalrm(Swallow *s)
 {
-	Swallow *t, **ps;
+	Swallow **ps;
 
-	if (s) {
-		for (ps = &swallows; *ps && *ps != s; ps = &(*ps)->next);
-		*ps = s->next;
-		free(s);
-	}
-	else {
-		for(s = swallows; s; s = t) {
-			t = s->next;
-			free(s);
-		}
-		swallows = NULL;
+	if (!s) {
+		while (swallows)
+			swalrm(swallows);
+		return;
 	}
+	for (ps = s->class[0] ? swalbucket(s->class) : &swalwild; *ps && *ps != s; ps = &(*ps)->next);
+	*ps = s->next;
+	if (s->qprev)
+		s->qprev->qnext = s->qnext;
+	else
+		swallows = s->qnext;
+	if (s->qnext)
+		s->qnext->qprev = s->qprev;
+	else
+		swallowslast = s->qprev;
+	free(s);
 }
 
 /*
@@ -5395,13 +6664,12 @@ swalrm(Swallow *s)
  */
 void swalunreg(Client *c) { Swallow *s;
 
-	for (s = swallows; s; s = s->next) {
-		if (c == s->client) {
-			swalrm(s);
-			/* Max. 1 registered swallow per client. No need to continue. */
-			break;
-		}
-	}
+	/* Max. 1 registered swallow per client. */
+	for (s = swallows; s && s->client != c; s = s->qnext);
+	if (s)
+		swalrm(s);
+	if (c && c->win == swalcand.win)
+		swalcand.win = None;
 }
 
 /*
@@ -5470,15 +6738,7 @@ swalstopsel(const Arg *unused)
 
 void spawnscratch(const Arg *arg)
 {
-	if (fork() == 0) {
-		if (dpy)
-			close(ConnectionNumber(dpy));
-		setsid();
-		execvp(((char **)arg->v)[1], ((char **)arg->v)+1);
-		fprintf(stderr, "dwm: execvp %s", ((char **)arg->v)[1]);
-		perror(" failed");
-		exit(EXIT_SUCCESS);
-	}
+	spawnprog(((char *const *)arg->v) + 1);
 }
 
 void
@@ -5584,6 +6844,81 @@ tagmon(const Arg *arg)
 	sendmon(selmon->sel, dirtomon(arg->i));
 }
 
+/* Sets timer_fd to expire at the earliest deadline */
+void
+timerarm(void)
+{
+	struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+
+	if (timers) {
+		/* a zero value would disarm, a deadline in the past expires
+		 * immediately */
+		its.it_value.tv_sec = timers->when / 1000000000;
+		its.it_value.tv_nsec = timers->when % 1000000000;
+		if (!timers->when)
+			its.it_value.tv_nsec = 1;
+	}
+	timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* Runs the timers which are due, called when timer_fd expired */
+void
+timerhandle(void)
+{
+	TRACE_SCOPE("timerhandle");
+	uint64_t expirations, now = nsnow();
+	Timer *t;
+
+	/* EAGAIN if the timer was armed again since it expired */
+	if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+		perror("dwm: cannot read timer");
+	/* take one timer at a time, the callbacks may set or stop timers */
+	while ((t = timers) && t->when <= now) {
+		timers = t->next;
+		t->armed = 0;
+		if (t->interval)
+			/* skip the runs which were missed instead of catching up */
+			timerset(t, t->when + t->interval > now ? t->when + t->interval - now : t->interval,
+				t->interval, t->func, t->arg);
+		t->func(t->arg);
+	}
+	timerarm();
+}
+
+/* Runs func(arg) from run() after delay ns and then every interval ns unless
+ * interval is 0. Setting an armed timer moves it. */
+void
+timerset(Timer *t, uint64_t delay, uint64_t interval, void (*func)(void *arg), void *arg)
+{
+	Timer **pt;
+
+	timerstop(t);
+	t->when = nsnow() + delay;
+	t->interval = interval;
+	t->func = func;
+	t->arg = arg;
+	for (pt = &timers; *pt && (*pt)->when <= t->when; pt = &(*pt)->next);
+	t->next = *pt;
+	*pt = t;
+	t->armed = 1;
+	if (timers == t)
+		timerarm();
+}
+
+void
+timerstop(Timer *t)
+{
+	Timer **pt;
+
+	if (!t->armed)
+		return;
+	for (pt = &timers; *pt != t; pt = &(*pt)->next);
+	*pt = t->next;
+	t->armed = 0;
+	if (pt == &timers)
+		timerarm();
+}
+
 void
 togglealttag()
 {
@@ -5881,6 +7216,7 @@ unmanage(Client *c, int destroyed)
 
 	/* Remove all swallow instances targeting client. */
 	swalunreg(c);
+	ipc_client_removed(c);
 
 	if (c == mark)
 		setmark(0);
@@ -5901,7 +7237,7 @@ unmanage(Client *c, int destroyed)
 	}
 	if (scratchpad_last_showed == c)
 		scratchpad_last_showed = NULL;
-	free(c);
+	clientfree(c);
 	focus(NULL);
 	updateclientlist();
 	arrange(m);
@@ -6125,20 +7461,17 @@ updategeom(void)
 void
 updatemotifhints(Client *c)
 {
-	Atom real;
-	int format;
-	unsigned char *p = NULL;
-	unsigned long n, extra;
-	unsigned long *motif;
+	xcb_get_property_reply_t *r;
+	uint32_t *motif;
 	int width, height;
 
 	if (!decorhints)
 		return;
 
-	if (XGetWindowProperty(dpy, c->win, motifatom, 0L, 5L, False, motifatom,
-	                       &real, &format, &n, &extra, &p) == Success && p != NULL) {
-		motif = (unsigned long*)p;
-		if (motif[MWM_HINTS_FLAGS_FIELD] & MWM_HINTS_DECORATIONS) {
+	if ((r = getprop(c->win, motifatom, motifatom, 5))) {
+		motif = xcb_get_property_value(r);
+		if (r->format == 32 && r->value_len > MWM_HINTS_DECORATIONS_FIELD
+		&& motif[MWM_HINTS_FLAGS_FIELD] & MWM_HINTS_DECORATIONS) {
 			width = WIDTH(c);
 			height = HEIGHT(c);
 
@@ -6151,7 +7484,7 @@ updatemotifhints(Client *c)
 
 			resize(c, c->x, c->y, width - (2*c->bw), height - (2*c->bw), 0);
 		}
-		XFree(p);
+		free(r);
 	}
 }
 
@@ -6174,12 +7507,32 @@ updatenumlockmask(void)
 void
 updatesizehints(Client *c)
 {
-	long msize;
-	XSizeHints size;
-
-	if (!XGetWMNormalHints(dpy, c->win, &size, &msize))
-		/* size is uninitialized, ensure that size.flags aren't used */
-		size.flags = PSize;
+	xcb_get_property_reply_t *r;
+	XSizeHints size = { .flags = PSize };
+	int32_t *v;
+
+	/* decoded like XGetWMNormalHints, pre-ICCCM hints lack the last three fields */
+	if ((r = getprop(c->win, XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS, 18))
+	&& r->format == 32 && r->value_len >= 15) {
+		v = xcb_get_property_value(r);
+		size.flags = v[0];
+		size.min_width = v[5];
+		size.min_height = v[6];
+		size.max_width = v[7];
+		size.max_height = v[8];
+		size.width_inc = v[9];
+		size.height_inc = v[10];
+		size.min_aspect.x = v[11];
+		size.min_aspect.y = v[12];
+		size.max_aspect.x = v[13];
+		size.max_aspect.y = v[14];
+		if (r->value_len >= 18) {
+			size.base_width = v[15];
+			size.base_height = v[16];
+		} else
+			size.flags &= ~(PBaseSize|PWinGravity);
+	}
+	free(r);
 	if (size.flags & PBaseSize) {
 		c->basew = size.base_width;
 		c->baseh = size.base_height;
@@ -6355,7 +7708,8 @@ updatesystray(void)
 	XSync(dpy, False);
 }
 
-void
+/* Reads the title of c and returns whether it changed */
+int
 updatetitle(Client *c)
 {
 	char oldname[sizeof(c->name)];
@@ -6368,19 +7722,43 @@ updatetitle(Client *c)
 
 	for (Monitor *m = mons; m; m = m->next) {
 		if (m->sel == c && strcmp(oldname, c->name) != 0)
-			ipc_focused_title_change_event(m->num, c->win, oldname, c->name);
+			ipc_focused_title_change_event(m->num, c->win, c->tags, oldname, c->name);
 	}
+	return strcmp(oldname, c->name) != 0;
 }
 
+/* Reads the titles which changed during the last batch of events once per
+ * client, however often they were set, and redraws only if the text did
+ * change. Clients like progress bars in terminals retitle many times per
+ * second, often with the same text. */
 void
-updatepreview(void)
+updatetitles(void)
 {
-	Monitor *m;
+	Client *c;
+	Swallow *s;
 
-	XSetWindowAttributes wa = {
-		.override_redirect = True,
-		.background_pixmap = ParentRelative,
-		.event_mask = ButtonPressMask|ExposureMask
+	while ((c = titlequeue)) {
+		titlequeue = c->titlenext;
+		c->titlepending = 0;
+		if (!updatetitle(c))
+			continue;
+		if (c == c->mon->sel)
+			drawbar(c->mon);
+		drawtab(c->mon);
+		if (swalretroactive && (s = swalmatch(c->win, strcmp(c->name, broken) ? c->name : "")))
+			swal(s->client, c, 0);
+	}
+}
+
+void
+updatepreview(void)
+{
+	Monitor *m;
+
+	XSetWindowAttributes wa = {
+		.override_redirect = True,
+		.background_pixmap = ParentRelative,
+		.event_mask = ButtonPressMask|ExposureMask
 	};
 	for (m = mons; m; m = m->next) {
 		m->tagwin = XCreateWindow(dpy, root, m->wx + sp, (topbar ? m->by + bh + vp : m->by + vp - m->mh / scalepreview), m->mw / scalepreview, m->mh / scalepreview, 0,
@@ -6416,20 +7794,37 @@ updatewindowtype(Client *c)
 void
 updatewmhints(Client *c)
 {
-	XWMHints *wmh;
-
-	if ((wmh = XGetWMHints(dpy, c->win))) {
-		if (c == selmon->sel && wmh->flags & XUrgencyHint) {
-			wmh->flags &= ~XUrgencyHint;
-			XSetWMHints(dpy, c->win, wmh);
+	xcb_get_property_reply_t *r;
+	XWMHints wmh = { 0 };
+	uint32_t *v;
+
+	/* decoded like XGetWMHints, pre-ICCCM hints lack the window group */
+	if ((r = getprop(c->win, XA_WM_HINTS, XA_WM_HINTS, 9))
+	&& r->format == 32 && r->value_len >= 8) {
+		v = xcb_get_property_value(r);
+		wmh.flags = v[0];
+		wmh.input = v[1];
+		wmh.initial_state = v[2];
+		wmh.icon_pixmap = v[3];
+		wmh.icon_window = v[4];
+		wmh.icon_x = v[5];
+		wmh.icon_y = v[6];
+		wmh.icon_mask = v[7];
+		if (r->value_len >= 9)
+			wmh.window_group = v[8];
+		else
+			wmh.flags &= ~WindowGroupHint;
+		if (c == selmon->sel && wmh.flags & XUrgencyHint) {
+			wmh.flags &= ~XUrgencyHint;
+			XSetWMHints(dpy, c->win, &wmh);
 		} else
-			c->isurgent = (wmh->flags & XUrgencyHint) ? 1 : 0;
-		if (wmh->flags & InputHint)
-			c->neverfocus = !wmh->input;
+			c->isurgent = (wmh.flags & XUrgencyHint) ? 1 : 0;
+		if (wmh.flags & InputHint)
+			c->neverfocus = !wmh.input;
 		else
 			c->neverfocus = 0;
-		XFree(wmh);
 	}
+	free(r);
 }
 
 void
@@ -6483,8 +7878,14 @@ winpid(Window w)
 	spec.mask = XCB_RES_CLIENT_ID_MASK_LOCAL_CLIENT_PID;
 
 	xcb_generic_error_t *e = NULL;
-	xcb_res_query_client_ids_cookie_t c = xcb_res_query_client_ids(xcon, 1, &spec);
-	xcb_res_query_client_ids_reply_t *r = xcb_res_query_client_ids_reply(xcon, c, &e);
+	xcb_res_query_client_ids_cookie_t c;
+	if (prefetch && prefetch->win == w && prefetch->pidpending) {
+		prefetch->pidpending = 0;
+		c = prefetch->pid;
+	} else
+		xcbseq = (c = xcb_res_query_client_ids(xcon, 1, &spec)).sequence;
+	xcb_res_query_client_ids_reply_t *r = xcbreply(c.sequence, &e);
+	free(e);
 
 	if (!r)
 		return (pid_t)0;
@@ -6621,6 +8022,47 @@ winview(const Arg* arg){
 	view(&a);
 }
 
+/* Called by Xlib after every request generating call. The last request
+ * processed by the server only advances when a reply (or event or error) was
+ * read, which for a call made by dwm means it waited for the server. */
+int
+xafter(Display *dpy)
+{
+	unsigned long r = LastKnownRequestProcessed(dpy);
+
+	if (r != xlastread) {
+		xlastread = r;
+		xroundtrips++;
+	}
+	return 0;
+}
+
+/* Waits for the reply to an XCB request, counting a round trip unless it
+ * has already arrived. xafter() only sees the waits of Xlib. */
+void *
+xcbreply(unsigned int sequence, xcb_generic_error_t **e)
+{
+	void *r = NULL;
+
+	if (!xcb_poll_for_reply(xcon, sequence, &r, e)) {
+		xroundtrips++;
+		r = xcb_wait_for_reply(xcon, sequence, e);
+	}
+	return r;
+}
+
+/* Returns the sequence number of the next request. Xlib only learns about
+ * requests sent through XCB once it sends one itself, so those are taken
+ * from the last XCB request. */
+unsigned long
+xnextrequest(void)
+{
+	unsigned long r = NextRequest(dpy);
+	int ahead = (int)(xcbseq + 1 - (unsigned int)r);
+
+	return ahead > 0 ? r + ahead : r;
+}
+
 /* There's no way to check accesses to destroyed windows, thus those cases are
  * ignored (especially on UnmapNotify's). Other types of errors call Xlibs
  * default error handler, which may call exit. */
@@ -6635,7 +8077,8 @@ xerror(Display *dpy, XErrorEvent *ee)
 	|| (ee->request_code == X_ConfigureWindow && ee->error_code == BadMatch)
 	|| (ee->request_code == X_GrabButton && ee->error_code == BadAccess)
 	|| (ee->request_code == X_GrabKey && ee->error_code == BadAccess)
-	|| (ee->request_code == X_CopyArea && ee->error_code == BadDrawable))
+	|| (ee->request_code == X_CopyArea && ee->error_code == BadDrawable)
+	|| (ee->request_code == X_GetAtomName && ee->error_code == BadAtom))
 		return 0;
 	fprintf(stderr, "dwm: fatal error: request code=%d, error code=%d\n",
 		ee->request_code, ee->error_code);
@@ -6710,6 +8153,66 @@ xinitvisual()
 	}
 }
 
+/* Reads the X resources again and applies them in place: colors, fonts, bar
+ * height and padding, border width and gaps. Clients stay managed, only the
+ * bars are redrawn and the clients rearranged. */
+void
+xrdb(const Arg *arg)
+{
+	TRACE_SCOPE("xrdb");
+	uint64_t start = nsnow();
+	Fnt *oldfonts = drw->fonts;
+	Clr **oldscheme;
+	Monitor *m;
+	Client *c;
+	int i;
+
+	load_xresources();
+	if (drw_fontset_create(drw, fonts, LENGTH(fonts)))
+		drw_fontset_free(oldfonts);
+	else {
+		fputs("dwm: xrdb: no fonts could be loaded, keeping the old ones\n", stderr);
+		drw_setfontset(drw, oldfonts);
+	}
+	lrpad = drw->fonts->h + horizpadbar;
+	bh = user_bh ? user_bh : drw->fonts->h + horizpadbar;
+	th = bh;
+	sp = sidepad;
+	vp = (topbar == 1) ? vertpad : - vertpad;
+
+	/* the old colors are freed once the new ones are allocated */
+	oldscheme = scheme;
+	scheme = ecalloc(LENGTH(colors) + 1, sizeof(Clr *));
+	scheme[LENGTH(colors)] = drw_scm_create(drw, colors[0], alphas[0], 4);
+	for (i = 0; i < LENGTH(colors); i++)
+		scheme[i] = drw_scm_create(drw, colors[i], alphas[i], 4);
+	for (i = 0; i < LENGTH(colors) + 1; i++)
+		drw_scm_free(drw, oldscheme[i], 4);
+	free(oldscheme);
+	drw_setscheme(drw, scheme[SchemeNorm]);
+
+	for (m = mons; m; m = m->next) {
+		m->borderpx = borderpx;
+		m->gappih = gappih;
+		m->gappiv = gappiv;
+		m->gappoh = gappoh;
+		m->gappov = gappov;
+		for (c = m->clients; c; c = c->next) {
+			if (!c->isfullscreen)
+				c->bw = m->borderpx;
+			XSetWindowBorder(dpy, c->win, scheme[c == m->sel && m == selmon ? SchemeSel : SchemeNorm][c == mark ? ColMark : ColBorder].pixel);
+		}
+		updatebarpos(m);
+		resizebarwin(m);
+		XMoveResizeWindow(dpy, m->extrabarwin, m->wx + sp, m->eby - vp, m->ww - 2 * sp, bh);
+	}
+	updatesystray();
+	arrange(NULL);
+	focus(NULL);
+	drawbars();
+	fprintf(stderr, "dwm: xrdb: reloaded in %.1f ms\n", (nsnow() - start) / 1e6);
+}
+
 void
 zoom(const Arg *arg)
 {
@@ -6917,6 +8420,7 @@ getfacts(Monitor *m, int msize, int ssize, float *mf, float *sf, int *mr, int *s
 static void
 bstack(Monitor *m)
 {
+	TRACE_SCOPE("bstack");
 	unsigned int i, n;
 	int oh, ov, ih, iv;
 	int mx = 0, my = 0, mh = 0, mw = 0;
@@ -6958,6 +8462,7 @@ bstack(Monitor *m)
 static void
 bstackhoriz(Monitor *m)
 {
+	TRACE_SCOPE("bstackhoriz");
 	unsigned int i, n;
 	int oh, ov, ih, iv;
 	int mx = 0, my = 0, mh = 0, mw = 0;
@@ -7004,6 +8509,7 @@ bstackhoriz(Monitor *m)
 void
 centeredmaster(Monitor *m)
 {
+	TRACE_SCOPE("centeredmaster");
 	unsigned int i, n;
 	int oh, ov, ih, iv;
 	int mx = 0, my = 0, mh = 0, mw = 0;
@@ -7089,6 +8595,7 @@ centeredmaster(Monitor *m)
 void
 centeredfloatingmaster(Monitor *m)
 {
+	TRACE_SCOPE("centeredfloatingmaster");
 	unsigned int i, n;
 	float mfacts, sfacts;
 	float mivf = 1.0; // master inner vertical gap factor
@@ -7146,6 +8653,7 @@ centeredfloatingmaster(Monitor *m)
 void
 deck(Monitor *m)
 {
+	TRACE_SCOPE("deck");
 	unsigned int i, n;
 	int oh, ov, ih, iv;
 	int mx = 0, my = 0, mh = 0, mw = 0;
@@ -7191,6 +8699,7 @@ deck(Monitor *m)
 void
 fibonacci(Monitor *m, int s)
 {
+	TRACE_SCOPE("fibonacci");
 	unsigned int i, n;
 	int nx, ny, nw, nh;
 	int oh, ov, ih, iv;
@@ -7294,6 +8803,7 @@ spiral(Monitor *m)
 void
 gaplessgrid(Monitor *m)
 {
+	TRACE_SCOPE("gaplessgrid");
 	unsigned int i, n;
 	int x, y, cols, rows, ch, cw, cn, rn, rrest, crest; // counters
 	int oh, ov, ih, iv;
@@ -7347,6 +8857,7 @@ gaplessgrid(Monitor *m)
 void
 grid(Monitor *m)
 {
+	TRACE_SCOPE("grid");
 	unsigned int i, n;
 	int cx, cy, cw, ch, cc, cr, chrest, cwrest, cols, rows;
 	int oh, ov, ih, iv;
@@ -7380,6 +8891,7 @@ grid(Monitor *m)
  */
 void
 horizgrid(Monitor *m) {
+	TRACE_SCOPE("horizgrid");
 	Client *c;
 	unsigned int n, i;
 	int oh, ov, ih, iv;
@@ -7446,6 +8958,7 @@ horizgrid(Monitor *m) {
 void
 nrowgrid(Monitor *m)
 {
+	TRACE_SCOPE("nrowgrid");
 	unsigned int n;
 	int ri = 0, ci = 0;  /* counters */
 	int oh, ov, ih, iv;                         /* vanitygap settings */
@@ -7503,6 +9016,7 @@ nrowgrid(Monitor *m)
 static void
 tile(Monitor *m)
 {
+	TRACE_SCOPE("tile");
 	unsigned int i, n;
 	int oh, ov, ih, iv;
 	int mx = 0, my = 0, mh = 0, mw = 0;
@@ -7852,6 +9366,40 @@ dump_monitors(yajl_gen gen, Monitor *mons, Monitor *selmon)
   return 0;
 }
 
+int
+dump_monitors_since(yajl_gen gen, Monitor *mons, Monitor *selmon,
+                    unsigned long since, unsigned long seq, int full,
+                    const Window *removed, int removed_len)
+{
+  int monitor_count = 0;
+  for (Monitor *mon = mons; mon; mon = mon->next) monitor_count++;
+
+  // clang-format off
+  YMAP(
+    YSTR("seq"); YINT(seq);
+    YSTR("full"); YBOOL(full);
+    YSTR("monitor_count"); YINT(monitor_count);
+    YSTR("monitors"); YARR(
+      for (Monitor *mon = mons; mon; mon = mon->next)
+        if (full || mon->stateseq > since)
+          dump_monitor(gen, mon, mon == selmon);
+    )
+    YSTR("clients"); YARR(
+      for (Monitor *mon = mons; mon; mon = mon->next)
+        for (Client *c = mon->clients; c; c = c->next)
+          if (full || c->stateseq > since)
+            dump_client(gen, c);
+    )
+    YSTR("removed_clients"); YARR(
+      for (int i = 0; i < removed_len; i++)
+        YINT(removed[i]);
+    )
+  )
+  // clang-format on
+
+  return 0;
+}
+
 int
 dump_layouts(yajl_gen gen, const Layout layouts[], const int layouts_len)
 {
@@ -8011,6 +9559,58 @@ dump_focused_state_change_event(yajl_gen gen, const int mon_num,
   return 0;
 }
 
+int
+dump_histogram(yajl_gen gen, const char *name, const Histogram *h)
+{
+  int last = STATBUCKETS - 1;
+  while (last > 0 && !h->buckets[last]) last--;
+
+  // clang-format off
+  YMAP(
+    YSTR("name"); YSTR(name);
+    YSTR("count"); YINT(h->count);
+    YSTR("total_ns"); YINT(h->total);
+    YSTR("mean_ns"); YINT(h->count ? h->total / h->count : 0);
+    YSTR("max_ns"); YINT(h->max);
+    // Bucket i counts durations in [2^i, 2^(i+1)) ns
+    YSTR("log2_ns_buckets"); YARR(
+      for (int i = 0; i <= last; i++)
+        YINT(h->buckets[i]);
+    )
+  )
+  // clang-format on
+
+  return 0;
+}
+
+int
+dump_xcallstats(yajl_gen gen, const char *name, const XCallStats *s)
+{
+  // clang-format off
+  YMAP(
+    YSTR("name"); YSTR(name);
+    YSTR("events"); YINT(s->events);
+    YSTR("requests"); YINT(s->requests);
+    YSTR("round_trips"); YINT(s->roundtrips);
+    YSTR("max_round_trips"); YINT(s->maxroundtrips);
+  )
+  // clang-format on
+
+  return 0;
+}
+
+int
+dump_success_message(yajl_gen gen)
+{
+  // clang-format off
+  YMAP(
+    YSTR("result"); YSTR("success");
+  )
+  // clang-format on
+
+  return 0;
+}
+
 int
 dump_error_message(yajl_gen gen, const char *reason)
 {
@@ -8219,12 +9819,69 @@ ipc_event_init_message(yajl_gen *gen)
   yajl_gen_config(*gen, yajl_gen_beautify, 1);
 }
 
+/**
+ * Get the index of an event into IPCClient.filters
+ */
+static int
+ipc_event_index(IPCEvent event)
+{
+  int i = 0;
+  while (!(event & 1) && i < IPC_EVENT_COUNT) {
+    event >>= 1;
+    i++;
+  }
+  return i;
+}
+
+/**
+ * Check if the subscription filter of an IPC client matches an event. A filter
+ * member only applies if the event carries the corresponding property.
+ *
+ * Returns 1 if the event should be sent to the client, 0 otherwise
+ */
+static int
+ipc_event_filter_match(const IPCEventFilter *f, const IPCEventContext *ctx)
+{
+  if (f->monitor >= 0 && ctx->mon_num[0] >= 0 &&
+      f->monitor != ctx->mon_num[0] && f->monitor != ctx->mon_num[1])
+    return 0;
+  if (f->tags && ctx->tags && !(f->tags & ctx->tags)) return 0;
+  if (f->window && (ctx->win[0] || ctx->win[1]) && f->window != ctx->win[0] &&
+      f->window != ctx->win[1])
+    return 0;
+  if (f->fields && ctx->fields && !(f->fields & ctx->fields)) return 0;
+  return 1;
+}
+
+/**
+ * Check if an IPC client is subscribed to the event and its filter matches
+ */
+static int
+ipc_event_wanted_by(IPCClient *c, IPCEvent event, const IPCEventContext *ctx)
+{
+  return (c->subscriptions & event) &&
+         ipc_event_filter_match(&c->filters[ipc_event_index(event)], ctx);
+}
+
+/**
+ * Check if any IPC client wants the event. This is used to skip serializing
+ * events that would not be sent to anyone.
+ */
+static int
+ipc_event_wanted(IPCEvent event, const IPCEventContext *ctx)
+{
+  for (IPCClient *c = ipc_clients; c; c = c->next)
+    if (ipc_event_wanted_by(c, event, ctx)) return 1;
+  return 0;
+}
+
 /**
  * Prepares buffers of IPC subscribers of specified event using buffer from yajl
- * handle.
+ * handle. Only subscribers whose filter matches the event context receive it.
  */
 static void
-ipc_event_prepare_send_message(yajl_gen gen, IPCEvent event)
+ipc_event_prepare_send_message(yajl_gen gen, IPCEvent event,
+                               const IPCEventContext *ctx)
 {
   const unsigned char *buffer;
   size_t len = 0;
@@ -8233,7 +9890,7 @@ ipc_event_prepare_send_message(yajl_gen gen, IPCEvent event)
   len++;  // For null char
 
   for (IPCClient *c = ipc_clients; c; c = c->next) {
-    if (c->subscriptions & event) {
+    if (ipc_event_wanted_by(c, event, ctx)) {
       DEBUG("Sending selected client change event to fd %d\n", c->fd);
       ipc_prepare_send_message(c, IPC_TYPE_EVENT, len, (char *)buffer);
     }
@@ -8278,7 +9935,8 @@ ipc_reply_prepare_send_message(yajl_gen gen, IPCClient *c,
 /**
  * Find the IPCCommand with the specified name
  *
- * Returns 0 if a command with the specified name was found
+ * Returns the index of the command if a command with the specified name was
+ * found
  * Returns -1 if a command with the specified name could not be found
  */
 static int
@@ -8287,7 +9945,7 @@ ipc_get_ipc_command(const char *name, IPCCommand *ipc_command)
   for (int i = 0; i < ipc_commands_len; i++) {
     if (strcmp(ipc_commands[i].name, name) == 0) {
       *ipc_command = ipc_commands[i];
-      return 0;
+      return i;
     }
   }
 
@@ -8295,28 +9953,16 @@ ipc_get_ipc_command(const char *name, IPCCommand *ipc_command)
 }
 
 /**
- * Parse a IPC_TYPE_RUN_COMMAND message from a client. This function extracts
- * the arguments, argument count, argument types, and command name and returns
- * the parsed information as an IPCParsedCommand. If this function returns
- * successfully, the parsed_command must be freed using
- * ipc_free_parsed_command_members.
+ * Parse an already parsed JSON command object, either the whole
+ * IPC_TYPE_RUN_COMMAND message or one element of an IPC_TYPE_RUN_BATCH array.
+ * The yajl tree is not freed by this function.
  *
- * Returns 0 if the message was successfully parsed
+ * Returns 0 if the command was successfully parsed
  * Returns -1 otherwise
  */
 static int
-ipc_parse_run_command(char *msg, IPCParsedCommand *parsed_command)
+ipc_parse_run_command_val(yajl_val parent, IPCParsedCommand *parsed_command)
 {
-  char error_buffer[1000];
-  yajl_val parent = yajl_tree_parse(msg, error_buffer, 1000);
-
-  if (parent == NULL) {
-    fputs("Failed to parse command from client\n", stderr);
-    fprintf(stderr, "%s\n", error_buffer);
-    fprintf(stderr, "Tried to parse: %s\n", msg);
-    return -1;
-  }
-
   // Format:
   // {
   //   "command": "<command name>"
@@ -8327,7 +9973,6 @@ ipc_parse_run_command(char *msg, IPCParsedCommand *parsed_command)
 
   if (command_val == NULL) {
     fputs("No command key found in client message\n", stderr);
-    yajl_tree_free(parent);
     return -1;
   }
 
@@ -8343,7 +9988,8 @@ ipc_parse_run_command(char *msg, IPCParsedCommand *parsed_command)
 
   if (args_val == NULL) {
     fputs("No args key found in client message\n", stderr);
-    yajl_tree_free(parent);
+    free(parsed_command->name);
+    parsed_command->name = NULL;
     return -1;
   }
 
@@ -8398,9 +10044,36 @@ ipc_parse_run_command(char *msg, IPCParsedCommand *parsed_command)
     }
   }
 
+  return 0;
+}
+
+/**
+ * Parse a IPC_TYPE_RUN_COMMAND message from a client. This function extracts
+ * the arguments, argument count, argument types, and command name and returns
+ * the parsed information as an IPCParsedCommand. If this function returns
+ * successfully, the parsed_command must be freed using
+ * ipc_free_parsed_command_members.
+ *
+ * Returns 0 if the message was successfully parsed
+ * Returns -1 otherwise
+ */
+static int
+ipc_parse_run_command(char *msg, IPCParsedCommand *parsed_command)
+{
+  char error_buffer[1000];
+  yajl_val parent = yajl_tree_parse(msg, error_buffer, 1000);
+
+  if (parent == NULL) {
+    fputs("Failed to parse command from client\n", stderr);
+    fprintf(stderr, "%s\n", error_buffer);
+    fprintf(stderr, "Tried to parse: %s\n", msg);
+    return -1;
+  }
+
+  int ret = ipc_parse_run_command_val(parent, parsed_command);
   yajl_tree_free(parent);
 
-  return 0;
+  return ret;
 }
 
 /**
@@ -8475,16 +10148,107 @@ ipc_event_stoi(const char *subscription, IPCEvent *event)
   return 0;
 }
 
+/**
+ * Convert a field name to an IPCEventField
+ *
+ * Returns 0 if a valid field name was given
+ * Returns -1 otherwise
+ */
+static int
+ipc_field_stoi(const char *name, IPCEventField *field)
+{
+  if (strcmp(name, "selected") == 0)
+    *field = IPC_FIELD_SELECTED;
+  else if (strcmp(name, "occupied") == 0)
+    *field = IPC_FIELD_OCCUPIED;
+  else if (strcmp(name, "urgent") == 0)
+    *field = IPC_FIELD_URGENT;
+  else if (strcmp(name, "symbol") == 0)
+    *field = IPC_FIELD_SYMBOL;
+  else if (strcmp(name, "address") == 0)
+    *field = IPC_FIELD_ADDRESS;
+  else if (strcmp(name, "name") == 0)
+    *field = IPC_FIELD_NAME;
+  else if (strcmp(name, "old_state") == 0)
+    *field = IPC_FIELD_OLD_STATE;
+  else if (strcmp(name, "is_fixed") == 0)
+    *field = IPC_FIELD_IS_FIXED;
+  else if (strcmp(name, "is_floating") == 0)
+    *field = IPC_FIELD_IS_FLOATING;
+  else if (strcmp(name, "is_fullscreen") == 0)
+    *field = IPC_FIELD_IS_FULLSCREEN;
+  else if (strcmp(name, "is_urgent") == 0)
+    *field = IPC_FIELD_IS_URGENT;
+  else if (strcmp(name, "never_focus") == 0)
+    *field = IPC_FIELD_NEVER_FOCUS;
+  else
+    return -1;
+  return 0;
+}
+
+/**
+ * Parse the optional filter keys of an IPC_TYPE_SUBSCRIBE message. Keys that
+ * are not present leave the filter matching anything.
+ *
+ * Returns 0 if the filter was successfully parsed
+ * Returns -1 otherwise
+ */
+static int
+ipc_parse_event_filter(yajl_val parent, IPCEventFilter *filter)
+{
+  *filter = (IPCEventFilter){.monitor = -1};
+
+  const char *monitor_path[] = {"monitor", 0};
+  yajl_val monitor_val = yajl_tree_get(parent, monitor_path, yajl_t_number);
+  if (monitor_val != NULL) {
+    if (!YAJL_IS_INTEGER(monitor_val)) return -1;
+    filter->monitor = YAJL_GET_INTEGER(monitor_val);
+  }
+
+  const char *tags_path[] = {"tags", 0};
+  yajl_val tags_val = yajl_tree_get(parent, tags_path, yajl_t_number);
+  if (tags_val != NULL) {
+    if (!YAJL_IS_INTEGER(tags_val)) return -1;
+    filter->tags = YAJL_GET_INTEGER(tags_val);
+  }
+
+  const char *window_path[] = {"window_id", 0};
+  yajl_val window_val = yajl_tree_get(parent, window_path, yajl_t_number);
+  if (window_val != NULL) {
+    if (!YAJL_IS_INTEGER(window_val)) return -1;
+    filter->window = YAJL_GET_INTEGER(window_val);
+  }
+
+  const char *fields_path[] = {"fields", 0};
+  yajl_val fields_val = yajl_tree_get(parent, fields_path, yajl_t_array);
+  if (fields_val != NULL) {
+    for (size_t i = 0; i < fields_val->u.array.len; i++) {
+      yajl_val field_val = fields_val->u.array.values[i];
+      IPCEventField field;
+
+      if (!YAJL_IS_STRING(field_val) ||
+          ipc_field_stoi(YAJL_GET_STRING(field_val), &field) < 0) {
+        fputs("Invalid field specified for subscription\n", stderr);
+        return -1;
+      }
+      filter->fields |= field;
+    }
+  }
+
+  return 0;
+}
+
 /**
  * Parse a IPC_TYPE_SUBSCRIBE message from a client. This function extracts the
- * event name and the subscription action from the message.
+ * event name, the subscription action and the subscription filter from the
+ * message.
  *
  * Returns 0 if message was successfully parsed
  * Returns -1 otherwise
  */
 static int
 ipc_parse_subscribe(const char *msg, IPCSubscriptionAction *subscribe,
-                    IPCEvent *event)
+                    IPCEvent *event, IPCEventFilter *filter)
 {
   char error_buffer[100];
   yajl_val parent = yajl_tree_parse((char *)msg, error_buffer, 100);
@@ -8499,6 +10263,10 @@ ipc_parse_subscribe(const char *msg, IPCSubscriptionAction *subscribe,
   // {
   //   "event": "<event name>"
   //   "action": "<subscribe|unsubscribe>"
+  //   "monitor": <monitor number>,      (optional)
+  //   "tags": <tag mask>,               (optional)
+  //   "window_id": <window id>,         (optional)
+  //   "fields": ["<field name>", ...]   (optional)
   // }
   const char *event_path[] = {"event", 0};
   yajl_val event_val = yajl_tree_get(parent, event_path, yajl_t_string);
@@ -8532,6 +10300,11 @@ ipc_parse_subscribe(const char *msg, IPCSubscriptionAction *subscribe,
     return -1;
   }
 
+  if (ipc_parse_event_filter(parent, filter) < 0) {
+    yajl_tree_free(parent);
+    return -1;
+  }
+
   yajl_tree_free(parent);
 
   return 0;
@@ -8576,6 +10349,58 @@ ipc_parse_get_dwm_client(const char *msg, Window *win)
   return 0;
 }
 
+/**
+ * Find the IPCCommand for a parsed command and validate its arguments. On
+ * failure a description of the error is written to err.
+ *
+ * Returns the index of the command if it exists and its arguments are valid
+ * Returns -1 otherwise
+ */
+static int
+ipc_resolve_command(IPCParsedCommand *parsed_command, char *err,
+                    size_t err_size)
+{
+  IPCCommand ipc_command;
+  int index = ipc_get_ipc_command(parsed_command->name, &ipc_command);
+
+  if (index < 0) {
+    snprintf(err, err_size, "Command %s not found", parsed_command->name);
+    return -1;
+  }
+
+  int res = ipc_validate_run_command(parsed_command, ipc_command);
+  if (res == -1) {
+    snprintf(err, err_size, "%u arguments provided, %u expected",
+             parsed_command->argc, ipc_command.argc);
+    return -1;
+  } else if (res == -2) {
+    snprintf(err, err_size, "Type mismatch");
+    return -1;
+  }
+
+  return index;
+}
+
+/**
+ * Call the function of a resolved command with its parsed arguments and
+ * record how long it took
+ */
+static void
+ipc_call_command(IPCParsedCommand *parsed_command, int index)
+{
+  IPCCommand ipc_command = ipc_commands[index];
+  uint64_t start = nsnow();
+
+  if (parsed_command->argc == 1)
+    ipc_command.func.single_param(parsed_command->args);
+  else if (parsed_command->argc > 1)
+    ipc_command.func.array_param(parsed_command->args, parsed_command->argc);
+
+  histadd(&ipc_command_stats[index], start);
+
+  DEBUG("Called function for command %s\n", parsed_command->name);
+}
+
 /**
  * Called when an IPC_TYPE_RUN_COMMAND message is received from a client. This
  * function parses, executes the given command, and prepares a reply message to
@@ -8592,8 +10417,9 @@ ipc_parse_get_dwm_client(const char *msg, Window *win)
 static int
 ipc_run_command(IPCClient *ipc_client, char *msg)
 {
+  TRACE_SCOPE("ipc_run_command");
   IPCParsedCommand parsed_command;
-  IPCCommand ipc_command;
+  char err[256];
 
   // Initialize struct
   memset(&parsed_command, 0, sizeof(IPCParsedCommand));
@@ -8604,37 +10430,94 @@ ipc_run_command(IPCClient *ipc_client, char *msg)
     return -1;
   }
 
-  if (ipc_get_ipc_command(parsed_command.name, &ipc_command) < 0) {
-    ipc_prepare_reply_failure(ipc_client, IPC_TYPE_RUN_COMMAND,
-                              "Command %s not found", parsed_command.name);
+  int index = ipc_resolve_command(&parsed_command, err, sizeof(err));
+  if (index < 0) {
+    ipc_prepare_reply_failure(ipc_client, IPC_TYPE_RUN_COMMAND, "%s", err);
     ipc_free_parsed_command_members(&parsed_command);
     return -1;
   }
 
-  int res = ipc_validate_run_command(&parsed_command, ipc_command);
-  if (res < 0) {
-    if (res == -1)
-      ipc_prepare_reply_failure(ipc_client, IPC_TYPE_RUN_COMMAND,
-                                "%u arguments provided, %u expected",
-                                parsed_command.argc, ipc_command.argc);
-    else if (res == -2)
-      ipc_prepare_reply_failure(ipc_client, IPC_TYPE_RUN_COMMAND,
-                                "Type mismatch");
-    ipc_free_parsed_command_members(&parsed_command);
+  ipc_call_command(&parsed_command, index);
+  ipc_free_parsed_command_members(&parsed_command);
+
+  ipc_prepare_reply_success(ipc_client, IPC_TYPE_RUN_COMMAND);
+  return 0;
+}
+
+/**
+ * Called when an IPC_TYPE_RUN_BATCH message is received from a client. The
+ * message is a JSON array of run_command objects. All commands are parsed and
+ * validated first; if any of them is invalid, none are run. Otherwise they are
+ * run in order with arrange and bar redraws held until the last one finished.
+ * The reply is an array with one result object per command.
+ *
+ * Returns 0 if the batch was run
+ * Returns -1 if the message could not be parsed or a command was invalid
+ */
+static int
+ipc_run_batch(IPCClient *ipc_client, char *msg)
+{
+  TRACE_SCOPE("ipc_run_batch");
+  char error_buffer[1000];
+  yajl_val parent = yajl_tree_parse(msg, error_buffer, 1000);
+
+  // Format:
+  // [
+  //   { "command": "<command name>", "args": [ ... ] },
+  //   ...
+  // ]
+  if (parent == NULL || !YAJL_IS_ARRAY(parent)) {
+    fputs("Failed to parse batch from client\n", stderr);
+    if (parent == NULL) fprintf(stderr, "%s\n", error_buffer);
+    ipc_prepare_reply_failure(ipc_client, IPC_TYPE_RUN_BATCH,
+                              "Failed to parse batch, expected an array");
+    yajl_tree_free(parent);
     return -1;
   }
 
-  if (parsed_command.argc == 1)
-    ipc_command.func.single_param(parsed_command.args);
-  else if (parsed_command.argc > 1)
-    ipc_command.func.array_param(parsed_command.args, parsed_command.argc);
+  size_t len = parent->u.array.len;
+  IPCParsedCommand *parsed = calloc(len, sizeof(IPCParsedCommand));
+  int *commands = calloc(len, sizeof(int));
+  char(*errors)[256] = calloc(len, sizeof(*errors));
+  int invalid = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    if (ipc_parse_run_command_val(parent->u.array.values[i], &parsed[i]) < 0) {
+      snprintf(errors[i], sizeof(errors[i]), "Failed to parse run command");
+      invalid = 1;
+    } else if ((commands[i] = ipc_resolve_command(&parsed[i], errors[i],
+                                                  sizeof(errors[i]))) < 0)
+      invalid = 1;
+  }
 
-  DEBUG("Called function for command %s\n", parsed_command.name);
+  if (!invalid) {
+    holdupdates();
+    for (size_t i = 0; i < len; i++) ipc_call_command(&parsed[i], commands[i]);
+    releaseupdates();
+  }
 
-  ipc_free_parsed_command_members(&parsed_command);
+  yajl_gen gen;
+  ipc_reply_init_message(&gen);
+  yajl_gen_array_open(gen);
+  for (size_t i = 0; i < len; i++) {
+    if (errors[i][0])
+      dump_error_message(gen, errors[i]);
+    else if (invalid)
+      dump_error_message(gen, "Not run, batch contains invalid commands");
+    else
+      dump_success_message(gen);
+  }
+  yajl_gen_array_close(gen);
+  ipc_reply_prepare_send_message(gen, ipc_client, IPC_TYPE_RUN_BATCH);
+
+  for (size_t i = 0; i < len; i++)
+    if (parsed[i].name) ipc_free_parsed_command_members(&parsed[i]);
+  free(parsed);
+  free(commands);
+  free(errors);
+  yajl_tree_free(parent);
 
-  ipc_prepare_reply_success(ipc_client, IPC_TYPE_RUN_COMMAND);
-  return 0;
+  return invalid ? -1 : 0;
 }
 
 /**
@@ -8644,6 +10527,7 @@ ipc_run_command(IPCClient *ipc_client, char *msg)
 static void
 ipc_get_monitors(IPCClient *c, Monitor *mons, Monitor *selmon)
 {
+  TRACE_SCOPE("ipc_get_monitors");
   yajl_gen gen;
   ipc_reply_init_message(&gen);
   dump_monitors(gen, mons, selmon);
@@ -8651,6 +10535,247 @@ ipc_get_monitors(IPCClient *c, Monitor *mons, Monitor *selmon)
   ipc_reply_prepare_send_message(gen, c, IPC_TYPE_GET_MONITORS);
 }
 
+/**
+ * FNV-1a hash used to detect state changes of monitors and clients
+ */
+static uint64_t
+ipc_hash(uint64_t h, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  for (size_t i = 0; i < len; i++) h = (h ^ p[i]) * 1099511628211ULL;
+  return h;
+}
+
+/**
+ * Hash all the client properties that are part of dump_client
+ */
+static uint64_t
+ipc_client_state_hash(Client *c)
+{
+  int v[] = {c->tags,      c->mon->num,   c->x,          c->y,
+             c->w,         c->h,          c->oldx,       c->oldy,
+             c->oldw,      c->oldh,       c->basew,      c->baseh,
+             c->incw,      c->inch,       c->maxw,       c->maxh,
+             c->minw,      c->minh,       c->bw,         c->oldbw,
+             c->isfixed,   c->isfloating, c->isurgent,   c->neverfocus,
+             c->oldstate,  c->isfullscreen};
+  float a[] = {c->mina, c->maxa};
+  uint64_t h = 14695981039346656037ULL;
+
+  h = ipc_hash(h, c->name, strlen(c->name));
+  h = ipc_hash(h, v, sizeof(v));
+  h = ipc_hash(h, a, sizeof(a));
+  return ipc_hash(h, &c->win, sizeof(c->win));
+}
+
+/**
+ * Hash all the monitor properties that are part of dump_monitor
+ */
+static uint64_t
+ipc_monitor_state_hash(Monitor *m, int is_selected)
+{
+  int v[] = {m->nmaster,
+             m->num,
+             is_selected,
+             m->mx,
+             m->my,
+             m->mw,
+             m->mh,
+             m->wx,
+             m->wy,
+             m->ww,
+             m->wh,
+             m->tagset[m->seltags],
+             m->tagset[m->seltags ^ 1],
+             m->tagstate.selected,
+             m->tagstate.occupied,
+             m->tagstate.urgent,
+             m->by,
+             m->showbar,
+             m->topbar};
+  const void *p[] = {m->lt[m->sellt], m->lt[m->sellt ^ 1]};
+  Window w[] = {m->sel ? m->sel->win : 0, m->barwin};
+  uint64_t h = 14695981039346656037ULL;
+
+  h = ipc_hash(h, &m->mfact, sizeof(m->mfact));
+  h = ipc_hash(h, v, sizeof(v));
+  h = ipc_hash(h, p, sizeof(p));
+  h = ipc_hash(h, w, sizeof(w));
+  h = ipc_hash(h, m->ltsymbol, strlen(m->ltsymbol) + 1);
+  h = ipc_hash(h, m->lastltsymbol, strlen(m->lastltsymbol) + 1);
+  for (Client *c = m->stack; c; c = c->snext)
+    h = ipc_hash(h, &c->win, sizeof(c->win));
+  for (Client *c = m->clients; c; c = c->next)
+    h = ipc_hash(h, &c->win, sizeof(c->win));
+  return h;
+}
+
+/**
+ * Assign a new sequence number to every monitor and client whose state
+ * changed since the last sync. Sequence numbers are assigned lazily when the
+ * state is queried, so idle pollers cost nothing on the event path.
+ */
+static void
+ipc_sync_state_seq(Monitor *mons, Monitor *selmon)
+{
+  for (Monitor *m = mons; m; m = m->next) {
+    uint64_t h = ipc_monitor_state_hash(m, m == selmon);
+    if (h != m->statehash) {
+      m->statehash = h;
+      m->stateseq = ++ipc_state_seq;
+    }
+
+    for (Client *c = m->clients; c; c = c->next) {
+      h = ipc_client_state_hash(c);
+      if (h != c->statehash) {
+        c->statehash = h;
+        c->stateseq = ++ipc_state_seq;
+      }
+    }
+  }
+}
+
+/**
+ * Parse an IPC_TYPE_GET_MONITORS_SINCE message from a client. This function
+ * extracts the sequence number from the message.
+ *
+ * Returns 0 if message was successfully parsed
+ * Returns -1 otherwise
+ */
+static int
+ipc_parse_get_monitors_since(const char *msg, unsigned long *since)
+{
+  char error_buffer[100];
+
+  yajl_val parent = yajl_tree_parse(msg, error_buffer, 100);
+
+  if (parent == NULL) {
+    fputs("Failed to parse message from client\n", stderr);
+    fprintf(stderr, "%s\n", error_buffer);
+    return -1;
+  }
+
+  // Format:
+  // {
+  //   "seq": <sequence number>
+  // }
+  const char *seq_path[] = {"seq", 0};
+  yajl_val seq_val = yajl_tree_get(parent, seq_path, yajl_t_number);
+
+  if (seq_val == NULL || !YAJL_IS_INTEGER(seq_val) ||
+      YAJL_GET_INTEGER(seq_val) < 0) {
+    fputs("No valid sequence number found in client message\n", stderr);
+    yajl_tree_free(parent);
+    return -1;
+  }
+
+  *since = YAJL_GET_INTEGER(seq_val);
+
+  yajl_tree_free(parent);
+
+  return 0;
+}
+
+/**
+ * Called when an IPC_TYPE_GET_MONITORS_SINCE message is received from a
+ * client. It prepares a reply with the current sequence number and only the
+ * monitors and clients that changed after the requested sequence number, plus
+ * the window ids of clients removed since then. If tombstones older than the
+ * requested sequence number were already dropped, or the sequence number is
+ * 0, a full snapshot is sent with "full" set.
+ *
+ * Returns 0 if the message was successfully parsed
+ * Returns -1 otherwise
+ */
+static int
+ipc_get_monitors_since(IPCClient *c, const char *msg, Monitor *mons,
+                       Monitor *selmon)
+{
+  TRACE_SCOPE("ipc_get_monitors_since");
+  unsigned long since;
+  Window removed[IPC_TOMBSTONES];
+  int removed_len = 0;
+
+  if (ipc_parse_get_monitors_since(msg, &since) < 0) {
+    ipc_prepare_reply_failure(c, IPC_TYPE_GET_MONITORS_SINCE,
+                              "Failed to parse sequence number");
+    return -1;
+  }
+
+  ipc_sync_state_seq(mons, selmon);
+
+  // Sequence numbers from before a restart are below the start of this
+  // process, see ipc_init, or possibly ahead of it if the clock was set back
+  int full = since == 0 || since < ipc_tombstones_dropped ||
+             since > ipc_state_seq;
+  unsigned long first = ipc_tombstones_len > IPC_TOMBSTONES
+                            ? ipc_tombstones_len - IPC_TOMBSTONES
+                            : 0;
+
+  for (unsigned long i = first; !full && i < ipc_tombstones_len; i++) {
+    unsigned long j = i % IPC_TOMBSTONES;
+    // Skip windows that have been managed again since they were removed
+    if (ipc_tombstones[j].seq > since && !wintoclient(ipc_tombstones[j].win))
+      removed[removed_len++] = ipc_tombstones[j].win;
+  }
+
+  yajl_gen gen;
+  ipc_reply_init_message(&gen);
+  dump_monitors_since(gen, mons, selmon, since, ipc_state_seq, full, removed,
+                      removed_len);
+
+  ipc_reply_prepare_send_message(gen, c, IPC_TYPE_GET_MONITORS_SINCE);
+  return 0;
+}
+
+/**
+ * Called when an IPC_TYPE_GET_STATS message is received from a client. It
+ * prepares a reply with the latency histograms of the X event handlers, the
+ * IPC commands and the arrange, drawbar and restack functions, and the X
+ * requests and round trips made per handled event type.
+ */
+static void
+ipc_get_stats(IPCClient *c)
+{
+  TRACE_SCOPE("ipc_get_stats");
+  yajl_gen gen;
+  ipc_reply_init_message(&gen);
+
+  // clang-format off
+  YMAP(
+    YSTR("events"); YARR(
+      for (int i = 0; i < LASTEvent; i++)
+        if (eventstats[i].count)
+          dump_histogram(gen, xeventname[i] ? xeventname[i] : "unknown",
+                         &eventstats[i]);
+    )
+    YSTR("commands"); YARR(
+      for (int i = 0; i < ipc_commands_len; i++)
+        if (ipc_command_stats[i].count)
+          dump_histogram(gen, ipc_commands[i].name, &ipc_command_stats[i]);
+    )
+    YSTR("functions"); YARR(
+      dump_histogram(gen, "arrange", &arrangestats);
+      dump_histogram(gen, "drawbar", &drawbarstats);
+      dump_histogram(gen, "restack", &restackstats);
+    )
+    YSTR("spawns"); YARR(
+      for (int i = 0; i < spawnstatslen; i++)
+        if (spawnstats[i].latency.count)
+          dump_histogram(gen, spawnstats[i].name, &spawnstats[i].latency);
+    )
+    YSTR("x_calls"); YARR(
+      for (int i = 0; i < LASTEvent; i++)
+        if (xcallstats[i].events)
+          dump_xcallstats(gen, xeventname[i] ? xeventname[i] : "unknown",
+                          &xcallstats[i]);
+    )
+  )
+  // clang-format on
+
+  ipc_reply_prepare_send_message(gen, c, IPC_TYPE_GET_STATS);
+}
+
 /**
  * Called when an IPC_TYPE_GET_TAGS message is received from a client. It
  * prepares a reply with info about all the tags in JSON.
@@ -8658,6 +10783,7 @@ ipc_get_monitors(IPCClient *c, Monitor *mons, Monitor *selmon)
 static void
 ipc_get_tags(IPCClient *c, const char *tags[], const int tags_len)
 {
+  TRACE_SCOPE("ipc_get_tags");
   yajl_gen gen;
   ipc_reply_init_message(&gen);
 
@@ -8673,6 +10799,7 @@ ipc_get_tags(IPCClient *c, const char *tags[], const int tags_len)
 static void
 ipc_get_layouts(IPCClient *c, const Layout layouts[], const int layouts_len)
 {
+  TRACE_SCOPE("ipc_get_layouts");
   yajl_gen gen;
   ipc_reply_init_message(&gen);
 
@@ -8693,6 +10820,7 @@ ipc_get_layouts(IPCClient *c, const Layout layouts[], const int layouts_len)
 static int
 ipc_get_dwm_client(IPCClient *ipc_client, const char *msg, const Monitor *mons)
 {
+  TRACE_SCOPE("ipc_get_dwm_client");
   Window win;
 
   if (ipc_parse_get_dwm_client(msg, &win) < 0) return -1;
@@ -8728,10 +10856,12 @@ ipc_get_dwm_client(IPCClient *ipc_client, const char *msg, const Monitor *mons)
 static int
 ipc_subscribe(IPCClient *c, const char *msg)
 {
+  TRACE_SCOPE("ipc_subscribe");
   IPCSubscriptionAction action = IPC_ACTION_SUBSCRIBE;
   IPCEvent event = 0;
+  IPCEventFilter filter;
 
-  if (ipc_parse_subscribe(msg, &action, &event)) {
+  if (ipc_parse_subscribe(msg, &action, &event, &filter)) {
     ipc_prepare_reply_failure(c, IPC_TYPE_SUBSCRIBE, "Event does not exist");
     return -1;
   }
@@ -8739,9 +10869,11 @@ ipc_subscribe(IPCClient *c, const char *msg)
   if (action == IPC_ACTION_SUBSCRIBE) {
     DEBUG("Subscribing client on fd %d to %d\n", c->fd, event);
     c->subscriptions |= event;
+    c->filters[ipc_event_index(event)] = filter;
   } else if (action == IPC_ACTION_UNSUBSCRIBE) {
     DEBUG("Unsubscribing client on fd %d to %d\n", c->fd, event);
     c->subscriptions ^= event;
+    c->filters[ipc_event_index(event)] = (IPCEventFilter){.monitor = -1};
   } else {
     ipc_prepare_reply_failure(c, IPC_TYPE_SUBSCRIBE,
                               "Invalid subscription action");
@@ -8759,11 +10891,19 @@ ipc_init(const char *socket_path, const int p_epoll_fd, IPCCommand commands[],
   // Initialize struct to 0
   memset(&sock_epoll_event, 0, sizeof(sock_epoll_event));
 
+  // Start sequence numbers at the current time in microseconds, so that
+  // those handed out before a restart always ask for a full dump
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ipc_state_seq = ipc_tombstones_dropped =
+      ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+
   int socket_fd = ipc_create_socket(socket_path);
   if (socket_fd < 0) return -1;
 
   ipc_commands = commands;
   ipc_commands_len = commands_len;
+  ipc_command_stats = ecalloc(commands_len, sizeof(Histogram));
 
   epoll_fd = p_epoll_fd;
 
@@ -8796,6 +10936,8 @@ ipc_cleanup()
   sock_fd = -1;
   ipc_commands = NULL;
   ipc_commands_len = 0;
+  free(ipc_command_stats);
+  ipc_command_stats = NULL;
   memset(&sock_epoll_event, 0, sizeof(struct epoll_event));
   memset(&sockaddr, 0, sizeof(struct sockaddr_un));
 
@@ -9022,63 +11164,140 @@ ipc_prepare_reply_success(IPCClient *c, IPCMessageType msg_type)
 void
 ipc_tag_change_event(int mon_num, TagState old_state, TagState new_state)
 {
+  unsigned int selected = old_state.selected ^ new_state.selected;
+  unsigned int occupied = old_state.occupied ^ new_state.occupied;
+  unsigned int urgent = old_state.urgent ^ new_state.urgent;
+  IPCEventContext ctx = {
+      .mon_num = {mon_num, -1},
+      .tags = selected | occupied | urgent,
+      .fields = (selected ? IPC_FIELD_SELECTED : 0) |
+                (occupied ? IPC_FIELD_OCCUPIED : 0) |
+                (urgent ? IPC_FIELD_URGENT : 0)};
+
+  if (!ipc_event_wanted(IPC_EVENT_TAG_CHANGE, &ctx)) return;
+
   yajl_gen gen;
   ipc_event_init_message(&gen);
   dump_tag_event(gen, mon_num, old_state, new_state);
-  ipc_event_prepare_send_message(gen, IPC_EVENT_TAG_CHANGE);
+  ipc_event_prepare_send_message(gen, IPC_EVENT_TAG_CHANGE, &ctx);
 }
 
 void
 ipc_client_focus_change_event(int mon_num, Client *old_client,
                               Client *new_client)
 {
+  IPCEventContext ctx = {
+      .mon_num = {mon_num, -1},
+      .win = {old_client ? old_client->win : 0,
+              new_client ? new_client->win : 0},
+      .tags = (old_client ? old_client->tags : 0) |
+              (new_client ? new_client->tags : 0)};
+
+  if (!ipc_event_wanted(IPC_EVENT_CLIENT_FOCUS_CHANGE, &ctx)) return;
+
   yajl_gen gen;
   ipc_event_init_message(&gen);
   dump_client_focus_change_event(gen, old_client, new_client, mon_num);
-  ipc_event_prepare_send_message(gen, IPC_EVENT_CLIENT_FOCUS_CHANGE);
+  ipc_event_prepare_send_message(gen, IPC_EVENT_CLIENT_FOCUS_CHANGE, &ctx);
 }
 
 void
-ipc_layout_change_event(const int mon_num, const char *old_symbol,
-                        const Layout *old_layout, const char *new_symbol,
-                        const Layout *new_layout)
+ipc_layout_change_event(const int mon_num, const unsigned int tags,
+                        const char *old_symbol, const Layout *old_layout,
+                        const char *new_symbol, const Layout *new_layout)
 {
+  IPCEventContext ctx = {
+      .mon_num = {mon_num, -1},
+      .tags = tags,
+      .fields = (strcmp(old_symbol, new_symbol) ? IPC_FIELD_SYMBOL : 0) |
+                (old_layout != new_layout ? IPC_FIELD_ADDRESS : 0)};
+
+  if (!ipc_event_wanted(IPC_EVENT_LAYOUT_CHANGE, &ctx)) return;
+
   yajl_gen gen;
   ipc_event_init_message(&gen);
   dump_layout_change_event(gen, mon_num, old_symbol, old_layout, new_symbol,
                            new_layout);
-  ipc_event_prepare_send_message(gen, IPC_EVENT_LAYOUT_CHANGE);
+  ipc_event_prepare_send_message(gen, IPC_EVENT_LAYOUT_CHANGE, &ctx);
 }
 
 void
 ipc_monitor_focus_change_event(const int last_mon_num, const int new_mon_num)
 {
+  IPCEventContext ctx = {.mon_num = {last_mon_num, new_mon_num}};
+
+  if (!ipc_event_wanted(IPC_EVENT_MONITOR_FOCUS_CHANGE, &ctx)) return;
+
   yajl_gen gen;
   ipc_event_init_message(&gen);
   dump_monitor_focus_change_event(gen, last_mon_num, new_mon_num);
-  ipc_event_prepare_send_message(gen, IPC_EVENT_MONITOR_FOCUS_CHANGE);
+  ipc_event_prepare_send_message(gen, IPC_EVENT_MONITOR_FOCUS_CHANGE, &ctx);
 }
 
 void
 ipc_focused_title_change_event(const int mon_num, const Window client_id,
-                               const char *old_name, const char *new_name)
+                               const unsigned int tags, const char *old_name,
+                               const char *new_name)
 {
+  IPCEventContext ctx = {.mon_num = {mon_num, -1},
+                         .win = {client_id, 0},
+                         .tags = tags,
+                         .fields = IPC_FIELD_NAME};
+
+  if (!ipc_event_wanted(IPC_EVENT_FOCUSED_TITLE_CHANGE, &ctx)) return;
+
   yajl_gen gen;
   ipc_event_init_message(&gen);
   dump_focused_title_change_event(gen, mon_num, client_id, old_name, new_name);
-  ipc_event_prepare_send_message(gen, IPC_EVENT_FOCUSED_TITLE_CHANGE);
+  ipc_event_prepare_send_message(gen, IPC_EVENT_FOCUSED_TITLE_CHANGE, &ctx);
 }
 
 void
 ipc_focused_state_change_event(const int mon_num, const Window client_id,
+                               const unsigned int tags,
                                const ClientState *old_state,
                                const ClientState *new_state)
 {
+  IPCEventContext ctx = {
+      .mon_num = {mon_num, -1},
+      .win = {client_id, 0},
+      .tags = tags,
+      .fields =
+          (old_state->oldstate != new_state->oldstate ? IPC_FIELD_OLD_STATE
+                                                      : 0) |
+          (old_state->isfixed != new_state->isfixed ? IPC_FIELD_IS_FIXED : 0) |
+          (old_state->isfloating != new_state->isfloating
+               ? IPC_FIELD_IS_FLOATING
+               : 0) |
+          (old_state->isfullscreen != new_state->isfullscreen
+               ? IPC_FIELD_IS_FULLSCREEN
+               : 0) |
+          (old_state->isurgent != new_state->isurgent ? IPC_FIELD_IS_URGENT
+                                                      : 0) |
+          (old_state->neverfocus != new_state->neverfocus
+               ? IPC_FIELD_NEVER_FOCUS
+               : 0)};
+
+  if (!ipc_event_wanted(IPC_EVENT_FOCUSED_STATE_CHANGE, &ctx)) return;
+
   yajl_gen gen;
   ipc_event_init_message(&gen);
   dump_focused_state_change_event(gen, mon_num, client_id, old_state,
                                   new_state);
-  ipc_event_prepare_send_message(gen, IPC_EVENT_FOCUSED_STATE_CHANGE);
+  ipc_event_prepare_send_message(gen, IPC_EVENT_FOCUSED_STATE_CHANGE, &ctx);
+}
+
+void
+ipc_client_removed(Client *c)
+{
+  unsigned long i = ipc_tombstones_len++ % IPC_TOMBSTONES;
+
+  if (ipc_tombstones_len > IPC_TOMBSTONES)
+    ipc_tombstones_dropped = ipc_tombstones[i].seq;
+  ipc_tombstones[i].win = c->win;
+  ipc_tombstones[i].seq = ++ipc_state_seq;
+  // Make sure the client gets a newer sequence number if it comes back
+  c->statehash = 0;
 }
 
 void
@@ -9108,8 +11327,8 @@ ipc_send_events(Monitor *mons, Monitor **lastselmon, Monitor *selmon)
 
     if (strcmp(m->ltsymbol, m->lastltsymbol) != 0 ||
         m->lastlt != m->lt[m->sellt]) {
-      ipc_layout_change_event(m->num, m->lastltsymbol, m->lastlt, m->ltsymbol,
-                              m->lt[m->sellt]);
+      ipc_layout_change_event(m->num, tagset, m->lastltsymbol, m->lastlt,
+                              m->ltsymbol, m->lt[m->sellt]);
       strcpy(m->lastltsymbol, m->ltsymbol);
       m->lastlt = m->lt[m->sellt];
     }
@@ -9130,7 +11349,7 @@ ipc_send_events(Monitor *mons, Monitor **lastselmon, Monitor *selmon)
                      .isurgent = sel->isurgent,
                      .neverfocus = sel->neverfocus};
     if (memcmp(o, &n, sizeof(ClientState)) != 0) {
-      ipc_focused_state_change_event(m->num, m->sel->win, o, &n);
+      ipc_focused_state_change_event(m->num, m->sel->win, sel->tags, o, &n);
       *o = n;
     }
   }
@@ -9158,16 +11377,24 @@ ipc_handle_client_epoll_event(struct epoll_event *ev, Monitor *mons,
 
     DEBUG("Received message from fd %d\n", fd);
     if (ipc_read_client(c, &msg_type, &msg_size, &msg) < 0) return -1;
+    if (recording) recordipc(msg_type, msg_size, msg);
 
     if (msg_type == IPC_TYPE_GET_MONITORS)
       ipc_get_monitors(c, mons, selmon);
-    else if (msg_type == IPC_TYPE_GET_TAGS)
+    else if (msg_type == IPC_TYPE_GET_STATS)
+      ipc_get_stats(c);
+    else if (msg_type == IPC_TYPE_GET_MONITORS_SINCE) {
+      if (ipc_get_monitors_since(c, msg, mons, selmon) < 0) return -1;
+    } else if (msg_type == IPC_TYPE_GET_TAGS)
       ipc_get_tags(c, tags, tags_len);
     else if (msg_type == IPC_TYPE_GET_LAYOUTS)
       ipc_get_layouts(c, layouts, layouts_len);
     else if (msg_type == IPC_TYPE_RUN_COMMAND) {
       if (ipc_run_command(c, msg) < 0) return -1;
       ipc_send_events(mons, lastselmon, selmon);
+    } else if (msg_type == IPC_TYPE_RUN_BATCH) {
+      if (ipc_run_batch(c, msg) < 0) return -1;
+      ipc_send_events(mons, lastselmon, selmon);
     } else if (msg_type == IPC_TYPE_GET_DWM_CLIENT) {
       if (ipc_get_dwm_client(c, msg, mons) < 0) return -1;
     } else if (msg_type == IPC_TYPE_SUBSCRIBE) {
@@ -9241,14 +11468,20 @@ load_xresources(void)
 	XrmDatabase db;
 	ResourcePref *p;
 
-	display = XOpenDisplay(NULL);
+	/* a new connection, the RESOURCE_MANAGER string of dpy is only read
+	 * when connecting and would not see changes made by xrdb since */
+	if (!(display = XOpenDisplay(NULL)))
+		return;
 	resm = XResourceManagerString(display);
-	if (!resm)
+	if (!resm) {
+		XCloseDisplay(display);
 		return;
+	}
 
 	db = XrmGetStringDatabase(resm);
 	for (p = resources; p < resources + LENGTH(resources); p++)
 		resource_load(db, p->name, p->type, p->dst);
+	XrmDestroyDatabase(db);
 	XCloseDisplay(display);
 }
 
@@ -9257,8 +11490,9 @@ main(int argc, char *argv[])
 {
 	if (argc == 2 && !strcmp("-v", argv[1]))
 		die("dwm-"VERSION);
-	else if (argc != 1 && strcmp("-s", argv[1]))
-		die("usage: dwm [-v]");
+	else if (argc != 1 && strcmp("-s", argv[1])
+	&& (argc != 3 || (strcmp("-r", argv[1]) && strcmp("-a", argv[1]))))
+		die("usage: dwm [-v] [-r|-a sessionlog]");
 	if (!setlocale(LC_CTYPE, "") || !XSupportsLocale())
 		fputs("warning: no locale support\n", stderr);
 	if (!(dpy = XOpenDisplay(NULL)))
@@ -9271,6 +11505,9 @@ main(int argc, char *argv[])
 		return 0;
 	}
 	checkotherwm();
+	if (argc == 3 && recordopen(argv[2], !strcmp("-a", argv[1])) < 0)
+		die("dwm: cannot open %s:", argv[2]);
+	uint64_t t0 = nsnow(), t1;
 	XrmInitialize();
 	load_xresources();
 	setup();
@@ -9278,10 +11515,21 @@ main(int argc, char *argv[])
 	if (pledge("stdio rpath proc exec", NULL) == -1)
 		die("pledge");
 #endif /* __OpenBSD__ */
+	t1 = nsnow();
 	scan();
+	fprintf(stderr, "dwm: startup: setup %.1f ms, scan %.1f ms\n",
+		(t1 - t0) / 1e6, (nsnow() - t1) / 1e6);
 	runautostart();
 	run();
-	if(restart) execvp(argv[0], argv);
+	recordclose();
+	if(restart) {
+		savesession();
+		/* keep recording to the same log */
+		if (argc == 3 && !strcmp("-r", argv[1]))
+			argv[1] = "-a";
+		execvp(argv[0], argv);
+		XDeleteProperty(dpy, root, XInternAtom(dpy, "_DWM_SESSION", False));
+	}
 	cleanup();
 	XCloseDisplay(dpy);
 	return EXIT_SUCCESS;
@@ -23,7 +23,10 @@ typedef enum IPCMessageType {
   IPC_TYPE_GET_LAYOUTS = 3,
   IPC_TYPE_GET_DWM_CLIENT = 4,
   IPC_TYPE_SUBSCRIBE = 5,
-  IPC_TYPE_EVENT = 6
+  IPC_TYPE_EVENT = 6,
+  IPC_TYPE_RUN_BATCH = 7,
+  IPC_TYPE_GET_MONITORS_SINCE = 8,
+  IPC_TYPE_GET_STATS = 9
 } IPCMessageType;
 
 typedef enum IPCEvent {
@@ -35,6 +38,29 @@ typedef enum IPCEvent {
   IPC_EVENT_FOCUSED_STATE_CHANGE = 1 << 5
 } IPCEvent;
 
+/**
+ * Fields of an event that a subscriber can express interest in. An event is
+ * only delivered if at least one of the fields of interest changed.
+ */
+typedef enum IPCEventField {
+  // tag_change_event
+  IPC_FIELD_SELECTED = 1 << 0,
+  IPC_FIELD_OCCUPIED = 1 << 1,
+  IPC_FIELD_URGENT = 1 << 2,
+  // layout_change_event
+  IPC_FIELD_SYMBOL = 1 << 3,
+  IPC_FIELD_ADDRESS = 1 << 4,
+  // focused_title_change_event
+  IPC_FIELD_NAME = 1 << 5,
+  // focused_state_change_event
+  IPC_FIELD_OLD_STATE = 1 << 6,
+  IPC_FIELD_IS_FIXED = 1 << 7,
+  IPC_FIELD_IS_FLOATING = 1 << 8,
+  IPC_FIELD_IS_FULLSCREEN = 1 << 9,
+  IPC_FIELD_IS_URGENT = 1 << 10,
+  IPC_FIELD_NEVER_FOCUS = 1 << 11
+} IPCEventField;
+
 typedef enum IPCSubscriptionAction {
   IPC_ACTION_UNSUBSCRIBE = 0,
   IPC_ACTION_SUBSCRIBE = 1
@@ -205,7 +231,8 @@ void ipc_prepare_reply_success(IPCClient *c, IPCMessageType msg_type);
 
 /**
  * Send a tag_change_event to all subscribers. Should be called only when there
- * has been a tag state change.
+ * has been a tag state change. The event is not serialized if no subscriber
+ * filter matches it.
  *
  * @param mon_num The index of the monitor (Monitor.num property)
  * @param old_state The old tag state
@@ -230,14 +257,15 @@ void ipc_client_focus_change_event(const int mon_num, Client *old_client,
  * when there has been a layout change.
  *
  * @param mon_num The index of the monitor (Monitor.num property)
+ * @param tags The currently selected tags of the monitor
  * @param old_symbol The old layout symbol
  * @param old_layout Address to the old Layout
  * @param new_symbol The new (now current) layout symbol
  * @param new_layout Address to the new Layout
  */
-void ipc_layout_change_event(const int mon_num, const char *old_symbol,
-                             const Layout *old_layout, const char *new_symbol,
-                             const Layout *new_layout);
+void ipc_layout_change_event(const int mon_num, const unsigned int tags,
+                             const char *old_symbol, const Layout *old_layout,
+                             const char *new_symbol, const Layout *new_layout);
 
 /**
  * Send a monitor_focus_change_event to all subscribers. Should be called only
@@ -255,10 +283,12 @@ void ipc_monitor_focus_change_event(const int last_mon_num,
  *
  * @param mon_num Index of the client's monitor
  * @param client_id Window XID of client
+ * @param tags Tags of the client
  * @param old_name Old name of the client window
  * @param new_name New name of the client window
  */
 void ipc_focused_title_change_event(const int mon_num, const Window client_id,
+                                    const unsigned int tags,
                                     const char *old_name, const char *new_name);
 
 /**
@@ -267,12 +297,22 @@ void ipc_focused_title_change_event(const int mon_num, const Window client_id,
  *
  * @param mon_num Index of the client's monitor
  * @param client_id Window XID of client
+ * @param tags Tags of the client
  * @param old_state Old state of the client
  * @param new_state New state of the client
  */
 void ipc_focused_state_change_event(const int mon_num, const Window client_id,
+                                    const unsigned int tags,
                                     const ClientState *old_state,
                                     const ClientState *new_state);
+/**
+ * Record a tombstone for a client that is no longer managed or was swallowed,
+ * so that get_monitors_since replies can report its removal.
+ *
+ * @param c The removed client
+ */
+void ipc_client_removed(Client *c);
+
 /**
  * Check to see if an event has occured and call the *_change_event functions
  * accordingly
@@ -0,0 +1,212 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#endif /* __linux__ */
+
+#include "proc.h"
+
+#ifdef __linux__
+#define PROCBUCKETS 1024 /* power of two */
+
+typedef struct ProcEntry ProcEntry;
+struct ProcEntry {
+	pid_t pid, ppid;
+	ProcEntry *next;
+};
+
+static ProcEntry *procs[PROCBUCKETS];
+static int procfd = -1;
+
+static ProcEntry **
+proclookup(pid_t p)
+{
+	ProcEntry **e;
+
+	for (e = &procs[p & (PROCBUCKETS - 1)]; *e && (*e)->pid != p; e = &(*e)->next);
+	return e;
+}
+
+static void
+procset(pid_t p, pid_t ppid)
+{
+	ProcEntry **e = proclookup(p);
+
+	if (!*e) {
+		if (!(*e = calloc(1, sizeof(ProcEntry))))
+			return;
+		(*e)->pid = p;
+	}
+	(*e)->ppid = ppid;
+}
+
+static void
+procdel(pid_t p)
+{
+	ProcEntry **e = proclookup(p), *t;
+
+	if ((t = *e)) {
+		*e = t->next;
+		free(t);
+	}
+}
+
+static void
+procflush(void)
+{
+	ProcEntry *e, *t;
+	size_t i;
+
+	for (i = 0; i < PROCBUCKETS; i++) {
+		for (e = procs[i]; e; e = t) {
+			t = e->next;
+			free(e);
+		}
+		procs[i] = NULL;
+	}
+}
+
+/* Reads the parent of p from /proc without stdio, 0 if p does not exist */
+static pid_t
+procread(pid_t p)
+{
+	char buf[512], *s;
+	ssize_t n;
+	int fd;
+
+	snprintf(buf, sizeof buf, "/proc/%u/stat", (unsigned)p);
+	if ((fd = open(buf, O_RDONLY | O_CLOEXEC)) < 0)
+		return 0;
+	n = read(fd, buf, sizeof buf - 1);
+	close(fd);
+	if (n <= 0)
+		return 0;
+	buf[n] = '\0';
+	/* the command name may contain spaces and parentheses, the state and
+	 * the parent pid follow its last closing parenthesis */
+	if (!(s = strrchr(buf, ')')))
+		return 0;
+	return (pid_t)strtol(s + 3, NULL, 10);
+}
+
+int
+procopen(void)
+{
+	struct sockaddr_nl sa = { .nl_family = AF_NETLINK, .nl_groups = CN_IDX_PROC };
+	union {
+		struct nlmsghdr nl;
+		char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+	} req;
+	struct cn_msg *cn;
+	enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+
+	if ((procfd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR)) < 0)
+		return -1;
+	memset(&req, 0, sizeof req);
+	req.nl.nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof op);
+	req.nl.nlmsg_type = NLMSG_DONE;
+	req.nl.nlmsg_pid = getpid();
+	cn = NLMSG_DATA(&req.nl);
+	cn->id.idx = CN_IDX_PROC;
+	cn->id.val = CN_VAL_PROC;
+	cn->len = sizeof op;
+	memcpy(cn->data, &op, sizeof op);
+	if (bind(procfd, (struct sockaddr *)&sa, sizeof sa) < 0
+	|| send(procfd, &req, req.nl.nlmsg_len, 0) < 0) {
+		close(procfd);
+		procfd = -1;
+	}
+	return procfd;
+}
+
+void
+procclose(void)
+{
+	if (procfd >= 0)
+		close(procfd);
+	procfd = -1;
+	procflush();
+}
+
+void
+prochandle(void)
+{
+	union {
+		struct nlmsghdr nl;
+		char buf[4096];
+	} msg;
+	struct nlmsghdr *nl;
+	struct cn_msg *cn;
+	struct proc_event *ev;
+	ssize_t n;
+
+	while ((n = recv(procfd, &msg, sizeof msg, 0)) != 0) {
+		if (n < 0) {
+			/* events were dropped, the cache can no longer be trusted */
+			if (errno == ENOBUFS)
+				procflush();
+			else if (errno != EINTR)
+				return;
+			continue;
+		}
+		for (nl = &msg.nl; NLMSG_OK(nl, (size_t)n); nl = NLMSG_NEXT(nl, n)) {
+			if (nl->nlmsg_type == NLMSG_ERROR || nl->nlmsg_type == NLMSG_NOOP)
+				continue;
+			cn = NLMSG_DATA(nl);
+			ev = (struct proc_event *)cn->data;
+			switch (ev->what) {
+			case PROC_EVENT_FORK:
+				/* new threads are reported as forks too */
+				if (ev->event_data.fork.child_pid == ev->event_data.fork.child_tgid)
+					procset(ev->event_data.fork.child_tgid, ev->event_data.fork.parent_tgid);
+				break;
+			case PROC_EVENT_EXIT:
+				if (ev->event_data.exit.process_pid == ev->event_data.exit.process_tgid)
+					procdel(ev->event_data.exit.process_tgid);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+pid_t
+procparent(pid_t p)
+{
+	ProcEntry *e;
+	pid_t ppid;
+
+	if (p <= 0)
+		return 0;
+	if (procfd < 0)
+		return procread(p);
+	if (!(e = *proclookup(p))) {
+		if ((ppid = procread(p)))
+			procset(p, ppid);
+		return ppid;
+	}
+	/* the parent exited and p was reparented, which the connector does
+	 * not report */
+	if (e->ppid > 1 && !*proclookup(e->ppid) && !(e->ppid = procread(p))) {
+		procdel(p);
+		return 0;
+	}
+	return e->ppid;
+}
+#else
+int procopen(void) { return -1; }
+void procclose(void) {}
+void prochandle(void) {}
+pid_t procparent(pid_t p) { return 0; }
+#endif /* __linux__ */
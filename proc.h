@@ -0,0 +1,15 @@
+/* See LICENSE file for copyright and license details. */
+
+/* Parent process lookups for swallowing and riodraw. On Linux the pid to
+ * parent pid map is kept in memory and updated from the fork and exit events
+ * of the netlink process connector. Without the connector, which needs
+ * CAP_NET_ADMIN, and for pids not seen yet /proc/<pid>/stat is read. */
+
+/* Subscribes to process events, returns the socket to poll or -1 if the
+ * connector is unavailable and every lookup reads /proc. */
+int procopen(void);
+void procclose(void);
+/* Reads the pending events, call when the socket is readable */
+void prochandle(void);
+/* Returns the parent of p or 0 if unknown */
+pid_t procparent(pid_t p);
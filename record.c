@@ -0,0 +1,245 @@
+/* See LICENSE file for copyright and license details. */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "record.h"
+
+int recording = 0;
+
+static FILE *recfile;
+static unsigned long long last; /* microseconds, see recnow() */
+static unsigned char *atomseen;
+static size_t atomseenlen;
+static Atom netwmstate;
+
+static unsigned long long
+recnow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void
+recordwrite(uint8_t kind, uint8_t type, const void *p, uint32_t len, const void *p2, uint32_t len2)
+{
+	unsigned long long now = recnow();
+	RecHeader h = { kind, type, 0, len + len2, now - last };
+
+	if (!recfile)
+		return;
+	last = now;
+	if (fwrite(&h, sizeof h, 1, recfile) != 1
+	|| (len && fwrite(p, len, 1, recfile) != 1)
+	|| (len2 && fwrite(p2, len2, 1, recfile) != 1)) {
+		fputs("dwm: cannot write session log, recording stopped\n", stderr);
+		recordclose();
+	}
+}
+
+/* Writes the name of the atom the first time it is referenced */
+static void
+recordatom(Display *dpy, Atom a)
+{
+	uint32_t id = a;
+	char *name;
+	size_t n;
+
+	if (a == None || a > 0xffffff)
+		return;
+	if (a >= atomseenlen * 8) {
+		n = (a / 8 + 1) * 2;
+		if (!(atomseen = realloc(atomseen, n)))
+			return;
+		memset(atomseen + atomseenlen, 0, n - atomseenlen);
+		atomseenlen = n;
+	}
+	if (atomseen[a / 8] & (1 << (a % 8)) || !(name = XGetAtomName(dpy, a)))
+		return;
+	atomseen[a / 8] |= 1 << (a % 8);
+	recordwrite(RecAtom, 0, &id, sizeof id, name, strlen(name) + 1);
+	XFree(name);
+}
+
+/* Writes class, instance and title of a window about to be managed, so the
+ * replay can create a window that matches the same rules */
+static void
+recordwindow(Display *dpy, Window w)
+{
+	XClassHint ch = { NULL, NULL };
+	char buf[768], *name = NULL;
+	uint32_t id = w;
+	int n;
+
+	XGetClassHint(dpy, w, &ch);
+	XFetchName(dpy, w, &name);
+	n = snprintf(buf, sizeof buf, "%s%c%s%c%s", ch.res_name ? ch.res_name : "", '\0',
+		ch.res_class ? ch.res_class : "", '\0', name ? name : "");
+	if (n >= (int)sizeof buf)
+		n = sizeof buf - 1;
+	recordwrite(RecWindow, 0, &id, sizeof id, buf, n + 1);
+	if (ch.res_name)
+		XFree(ch.res_name);
+	if (ch.res_class)
+		XFree(ch.res_class);
+	if (name)
+		XFree(name);
+}
+
+/* Starts a session log at path, or continues the one there if append is
+ * set, as dwm does when it restarts itself */
+int
+recordopen(const char *path, int append)
+{
+	if (!(recfile = fopen(path, append ? "ae" : "we")))
+		return -1;
+	if (!append || (fseek(recfile, 0, SEEK_END) == 0 && ftell(recfile) == 0))
+		fwrite(RECMAGIC, sizeof RECMAGIC, 1, recfile);
+	last = recnow();
+	recording = 1;
+	return 0;
+}
+
+void
+recordclose(void)
+{
+	if (!recfile)
+		return;
+	fclose(recfile);
+	recfile = NULL;
+	recording = 0;
+	free(atomseen);
+	atomseen = NULL;
+	atomseenlen = 0;
+}
+
+/* Records the fields of an event dwm handles that are needed to reproduce
+ * it. The args are:
+ *   KeyPress                  keycode, state
+ *   ButtonPress/Release       button, state, x_root, y_root
+ *   MotionNotify              x_root, y_root, state
+ *   EnterNotify               x_root, y_root, mode, detail
+ *   FocusIn                   mode, detail
+ *   PropertyNotify            atom, state
+ *   ClientMessage             message_type, data.l[0..4]
+ *   ConfigureRequest          x, y, width, height, border_width, value_mask
+ *   ConfigureNotify           x, y, width, height
+ *   ResizeRequest             width, height
+ *   UnmapNotify               send_event
+ *   Expose                    count
+ *   MappingNotify             request, first_keycode, count
+ * Other events only record the window. */
+void
+recordxevent(Display *dpy, XEvent *ev)
+{
+	RecXPayload p = { ev->xany.window, 0, { 0 } };
+	int n = 0, i;
+
+	if (!recfile)
+		return;
+	switch (ev->type) {
+	case KeyPress:
+		p.time = ev->xkey.time;
+		p.args[n++] = ev->xkey.keycode;
+		p.args[n++] = ev->xkey.state;
+		break;
+	case ButtonPress:
+	case ButtonRelease:
+		p.time = ev->xbutton.time;
+		p.args[n++] = ev->xbutton.button;
+		p.args[n++] = ev->xbutton.state;
+		p.args[n++] = ev->xbutton.x_root;
+		p.args[n++] = ev->xbutton.y_root;
+		break;
+	case MotionNotify:
+		p.time = ev->xmotion.time;
+		p.args[n++] = ev->xmotion.x_root;
+		p.args[n++] = ev->xmotion.y_root;
+		p.args[n++] = ev->xmotion.state;
+		break;
+	case EnterNotify:
+		p.time = ev->xcrossing.time;
+		p.args[n++] = ev->xcrossing.x_root;
+		p.args[n++] = ev->xcrossing.y_root;
+		p.args[n++] = ev->xcrossing.mode;
+		p.args[n++] = ev->xcrossing.detail;
+		break;
+	case FocusIn:
+		p.args[n++] = ev->xfocus.mode;
+		p.args[n++] = ev->xfocus.detail;
+		break;
+	case PropertyNotify:
+		recordatom(dpy, ev->xproperty.atom);
+		p.time = ev->xproperty.time;
+		p.args[n++] = ev->xproperty.atom;
+		p.args[n++] = ev->xproperty.state;
+		break;
+	case ClientMessage:
+		recordatom(dpy, ev->xclient.message_type);
+		/* _NET_WM_STATE carries the properties to change as atoms */
+		if (!netwmstate)
+			netwmstate = XInternAtom(dpy, "_NET_WM_STATE", False);
+		if (ev->xclient.message_type == netwmstate) {
+			recordatom(dpy, ev->xclient.data.l[1]);
+			recordatom(dpy, ev->xclient.data.l[2]);
+		}
+		p.args[n++] = ev->xclient.message_type;
+		for (i = 0; i < 5; i++)
+			p.args[n++] = ev->xclient.data.l[i];
+		break;
+	case ConfigureRequest:
+		p.window = ev->xconfigurerequest.window;
+		p.args[n++] = ev->xconfigurerequest.x;
+		p.args[n++] = ev->xconfigurerequest.y;
+		p.args[n++] = ev->xconfigurerequest.width;
+		p.args[n++] = ev->xconfigurerequest.height;
+		p.args[n++] = ev->xconfigurerequest.border_width;
+		p.args[n++] = ev->xconfigurerequest.value_mask;
+		break;
+	case ConfigureNotify:
+		p.window = ev->xconfigure.window;
+		p.args[n++] = ev->xconfigure.x;
+		p.args[n++] = ev->xconfigure.y;
+		p.args[n++] = ev->xconfigure.width;
+		p.args[n++] = ev->xconfigure.height;
+		break;
+	case ResizeRequest:
+		p.args[n++] = ev->xresizerequest.width;
+		p.args[n++] = ev->xresizerequest.height;
+		break;
+	case MapRequest:
+		p.window = ev->xmaprequest.window;
+		recordwindow(dpy, p.window);
+		break;
+	case UnmapNotify:
+		p.window = ev->xunmap.window;
+		p.args[n++] = ev->xunmap.send_event;
+		break;
+	case DestroyNotify:
+		p.window = ev->xdestroywindow.window;
+		break;
+	case Expose:
+		p.args[n++] = ev->xexpose.count;
+		break;
+	case MappingNotify:
+		p.args[n++] = ev->xmapping.request;
+		p.args[n++] = ev->xmapping.first_keycode;
+		p.args[n++] = ev->xmapping.count;
+		break;
+	}
+	if (p.window == DefaultRootWindow(dpy))
+		p.window = None;
+	recordwrite(RecXEvent, ev->type, &p, sizeof p - (RECARGS - n) * sizeof p.args[0], NULL, 0);
+}
+
+void
+recordipc(uint8_t type, uint32_t size, const char *msg)
+{
+	recordwrite(RecIPC, type, msg, size, NULL, 0);
+}
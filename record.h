@@ -0,0 +1,37 @@
+/* See LICENSE file for copyright and license details. */
+
+/* Session log written by dwm -r and read by bench/replay. The file starts
+ * with RECMAGIC, followed by records of a RecHeader and len bytes of payload.
+ * All fields are in host byte order.
+ *
+ * RecXEvent   RecXPayload with as many args as the event type uses
+ * RecIPC      the IPC message payload, type is the IPC message type
+ * RecAtom     uint32_t atom followed by its name, written before the first
+ *             record referring to the atom
+ * RecWindow   uint32_t window followed by "instance\0class\0title\0",
+ *             written before the MapRequest of the window
+ */
+#define RECMAGIC "DWMREC1"
+#define RECARGS 6
+
+enum { RecXEvent, RecIPC, RecAtom, RecWindow }; /* record kinds */
+
+typedef struct {
+	uint8_t kind;
+	uint8_t type;     /* X event or IPC message type */
+	uint16_t pad;
+	uint32_t len;     /* payload length */
+	uint32_t dt;      /* microseconds since the previous record */
+} RecHeader;
+
+typedef struct {
+	uint32_t window;  /* the window the event is about, None for the root window */
+	uint32_t time;    /* server time for input and property events, else 0 */
+	int32_t args[RECARGS]; /* event specific, see recordxevent() */
+} RecXPayload;
+
+int recordopen(const char *path, int append);
+void recordclose(void);
+void recordxevent(Display *dpy, XEvent *ev);
+void recordipc(uint8_t type, uint32_t size, const char *msg);
+extern int recording;
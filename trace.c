@@ -0,0 +1,66 @@
+/* See LICENSE file for copyright and license details. */
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#ifdef TRACE
+#define TRACEEVENTS 65536 /* ring buffer size, must be a power of two */
+
+typedef struct {
+	const char *name;
+	unsigned long long ts, dur; /* nanoseconds */
+} TraceEvent;
+
+static TraceEvent events[TRACEEVENTS];
+static unsigned long head; /* total number of recorded events */
+
+unsigned long long
+tracenow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+traceend(TraceScope *s)
+{
+	/* claim a slot without locking; once the ring is full the oldest
+	 * events are overwritten */
+	unsigned long i = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED) & (TRACEEVENTS - 1);
+
+	events[i].name = s->name;
+	events[i].ts = s->start;
+	events[i].dur = tracenow() - s->start;
+}
+
+int
+tracedump(const char *path)
+{
+	FILE *f;
+	TraceEvent *e;
+	unsigned long i, first, last = head;
+	int pid = getpid();
+
+	if (!(f = fopen(path, "w")))
+		return -1;
+	first = last > TRACEEVENTS ? last - TRACEEVENTS : 0;
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+	for (i = first; i < last; i++) {
+		e = &events[i & (TRACEEVENTS - 1)];
+		fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}\n",
+			i == first ? "" : ",", e->name, e->ts / 1e3, e->dur / 1e3, pid, pid);
+	}
+	fputs("]}\n", f);
+	return fclose(f) ? -1 : 0;
+}
+#else
+int
+tracedump(const char *path)
+{
+	return -1;
+}
+#endif
@@ -0,0 +1,22 @@
+/* See LICENSE file for copyright and license details. */
+
+#ifdef TRACE
+typedef struct {
+	const char *name;
+	unsigned long long start; /* nanoseconds, see tracenow() */
+} TraceScope;
+
+/* Records the enclosing block as a complete event named 'name' when the
+ * block is left. Use at most once per block. */
+#define TRACE_SCOPE(name) \
+	TraceScope tracescope __attribute__((cleanup(traceend))) = { (name), tracenow() }
+
+unsigned long long tracenow(void);
+void traceend(TraceScope *s);
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+/* Writes the recorded events as Chrome trace JSON, returns 0 on success and
+ * -1 on failure or if tracing was not compiled in. */
+int tracedump(const char *path);
@@ -32,6 +32,10 @@ int dump_monitor(yajl_gen gen, Monitor *mon, int is_selected);
 
 int dump_monitors(yajl_gen gen, Monitor *mons, Monitor *selmon);
 
+int dump_monitors_since(yajl_gen gen, Monitor *mons, Monitor *selmon,
+                        unsigned long since, unsigned long seq, int full,
+                        const Window *removed, int removed_len);
+
 int dump_layouts(yajl_gen gen, const Layout layouts[], const int layouts_len);
 
 int dump_tag_state(yajl_gen gen, TagState state);
@@ -60,6 +64,12 @@ int dump_focused_state_change_event(yajl_gen gen, const int mon_num,
                                     const ClientState *old_state,
                                     const ClientState *new_state);
 
+int dump_histogram(yajl_gen gen, const char *name, const Histogram *h);
+
+int dump_xcallstats(yajl_gen gen, const char *name, const XCallStats *s);
+
+int dump_success_message(yajl_gen gen);
+
 int dump_error_message(yajl_gen gen, const char *reason);
 
 #endif  // YAJL_DUMPS_H_